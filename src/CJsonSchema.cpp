@@ -8,9 +8,15 @@
 #include "json_input.h"
 #include "jsonkit_internal.h"
 
+#include "rapidjson/memorystream.h"
+#include "rapidjson/error/en.h"
+
 #include <stdio.h>
+#include <sys/stat.h>
+#include <chrono>
 #include <string>
 #include <map>
+#include <thread>
 
 namespace jsonkit
 {
@@ -26,9 +32,15 @@ public:
 	// virtual const rapidjson::SchemaDocument* GetRemoteDocument(const char* uri, size_t length);
 	virtual const rapidjson::SchemaDocument* GetRemoteDocument(const char* uri, rapidjson::SizeType length);
 
+    /// whether any remote schema file is modified since it is loaded
+    bool Modified() const;
+
 private:
 	std::string m_baseDir;
-	std::map<std::string, rapidjson::SchemaDocument*> m_mapSchema;
+	// remote schema shared from CSchemaRegistry, keep alive while in use
+	std::map<std::string, std::shared_ptr<const rapidjson::SchemaDocument>> m_mapSchema;
+	// remote schema file with the mtime and size when loaded
+	std::map<std::string, std::pair<int64_t, int64_t>> m_mapDepend;
 };
 
 CSchemaProvider::CSchemaProvider(const std::string& baseDir)
@@ -46,15 +58,34 @@ CSchemaProvider::CSchemaProvider(const std::string& baseDir)
 
 CSchemaProvider::~CSchemaProvider()
 {
-    std::map<std::string, rapidjson::SchemaDocument*>::iterator it;
-    for (it = m_mapSchema.begin(); it != m_mapSchema.end(); ++it)
+}
+
+// get modify time in nanosecond and size of a file
+static
+bool file_stat(const std::string& file, int64_t& mtime, int64_t& size)
+{
+    struct stat st;
+    if (stat(file.c_str(), &st) != 0)
+    {
+        return false;
+    }
+    mtime = int64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    size = st.st_size;
+    return true;
+}
+
+bool CSchemaProvider::Modified() const
+{
+    for (auto& item : m_mapDepend)
     {
-        if (it->second != NULL)
+        int64_t mtime = 0;
+        int64_t size = 0;
+        if (!file_stat(item.first, mtime, size) || mtime != item.second.first || size != item.second.second)
         {
-            delete it->second;
-            it->second = NULL;
+            return true;
         }
     }
+    return false;
 }
 
 static
@@ -83,37 +114,29 @@ const rapidjson::SchemaDocument* CSchemaProvider::GetRemoteDocument(const char*
     std::string jsonPath;
     break_string(uriKey, "#", jsonPath);
 
-    std::map<std::string, rapidjson::SchemaDocument*>::iterator it;
-    it = m_mapSchema.find(uriKey);
+    auto it = m_mapSchema.find(uriKey);
     if (it != m_mapSchema.end())
     {
         LOGD("Get the cached schema!");
-        return it->second;
+        return it->second.get();
     }
 
     std::string jsonFile = m_baseDir;
     jsonFile.append(uriKey);
 
-    rapidjson::Document docSchema;
-    if (!jsonkit::read_file(docSchema, jsonFile))
+    // the required is the whole SchemaDocument, not further parse #path or #id self.
+    CSchemaRegistry::entry_t entry = CSchemaRegistry::Instance().GetRemoteEntry(jsonFile);
+    if (!entry.remote)
     {
         LOGF("Fail to read schema json file: %s", jsonFile.c_str());
         return NULL;
     }
 
-    // the required is the whole SchemaDocument, not further parse #path or #id self.
-    rapidjson::SchemaDocument* pSchema = new rapidjson::SchemaDocument(docSchema);
-    if (pSchema != NULL)
-    {
-        m_mapSchema[uriKey] = pSchema;
-        LOGD("Save cache for schema json file: %s", uriKey.c_str());
-    }
-    else
-    {
-        LOGF("Fail to create new rapidjson::SchemaDocument");
-    }
+    m_mapSchema[uriKey] = entry.remote;
+    m_mapDepend[jsonFile] = std::make_pair(entry.mtime, entry.size);
+    LOGD("Save cache for schema json file: %s", uriKey.c_str());
 
-    return pSchema;
+    return entry.remote.get();
 }
 
 } // end of namespace jsonkit::CSchemaProvider
@@ -121,22 +144,45 @@ const rapidjson::SchemaDocument* CSchemaProvider::GetRemoteDocument(const char*
 namespace jsonkit
 {
 
+// pool size is a few times of cpu cores, enough for most working threads
+static
+size_t schema_pool_size()
+{
+    size_t cores = std::thread::hardware_concurrency();
+    return cores > 2 ? cores * 2 : 4;
+}
+
 CJsonSchema::CJsonSchema(const rapidjson::Value& doc, rapidjson::IRemoteSchemaDocumentProvider* provider)
     : m_provider(provider)
     , m_schema(doc, 0, 0, m_provider)
-    , m_validator(m_schema)
+    , m_poolSize(schema_pool_size())
+    , m_pool(new pool_slot_t[m_poolSize])
 {
+    for (size_t i = 0; i < m_poolSize; ++i)
+    {
+        m_pool[i].validator.store(NULL, std::memory_order_relaxed);
+    }
 }
 
 CJsonSchema::CJsonSchema(const rapidjson::Value& doc, const std::string& baseDir)
     : m_provider(new CSchemaProvider(baseDir))
     , m_schema(doc, 0, 0, m_provider)
-    , m_validator(m_schema)
+    , m_poolSize(schema_pool_size())
+    , m_pool(new pool_slot_t[m_poolSize])
 {
+    for (size_t i = 0; i < m_poolSize; ++i)
+    {
+        m_pool[i].validator.store(NULL, std::memory_order_relaxed);
+    }
 }
 
 CJsonSchema::~CJsonSchema()
 {
+    for (size_t i = 0; i < m_poolSize; ++i)
+    {
+        delete m_pool[i].validator.exchange(NULL);
+    }
+
     if (m_provider)
     {
         delete m_provider;
@@ -144,7 +190,85 @@ CJsonSchema::~CJsonSchema()
     }
 }
 
-bool CJsonSchema::Validate(const rapidjson::Value& json)
+// different threads start to scan the pool from different slot, each
+// thread take the next index when first use, so they spread evenly
+static inline
+size_t schema_pool_start(size_t size)
+{
+    static std::atomic<size_t> s_nextIndex(0);
+    static thread_local size_t t_index = s_nextIndex.fetch_add(1, std::memory_order_relaxed);
+    return t_index % size;
+}
+
+rapidjson::SchemaValidator* CJsonSchema::Acquire() const
+{
+    size_t start = schema_pool_start(m_poolSize);
+    for (size_t i = 0; i < m_poolSize; ++i)
+    {
+        std::atomic<rapidjson::SchemaValidator*>& slot = m_pool[(start + i) % m_poolSize].validator;
+        if (slot.load(std::memory_order_relaxed) == NULL)
+        {
+            continue;
+        }
+        rapidjson::SchemaValidator* validator = slot.exchange(NULL, std::memory_order_acquire);
+        if (validator != NULL)
+        {
+            return validator;
+        }
+    }
+
+    return new rapidjson::SchemaValidator(m_schema);
+}
+
+void CJsonSchema::Release(rapidjson::SchemaValidator* validator) const
+{
+    if (validator == NULL)
+    {
+        return;
+    }
+
+    size_t start = schema_pool_start(m_poolSize);
+    for (size_t i = 0; i < m_poolSize; ++i)
+    {
+        std::atomic<rapidjson::SchemaValidator*>& slot = m_pool[(start + i) % m_poolSize].validator;
+        rapidjson::SchemaValidator* expected = NULL;
+        if (slot.compare_exchange_strong(expected, validator, std::memory_order_release, std::memory_order_relaxed))
+        {
+            return;
+        }
+    }
+
+    delete validator;
+}
+
+// format error from SchemaValidator or SchemaValidatingReader
+template <typename validatorT>
+void format_schema_error(const validatorT& validator, std::string& strError)
+{
+    rapidjson::StringBuffer sb;
+    validator.GetInvalidSchemaPointer().StringifyUriFragment(sb);
+    strError.append("Invalid schema: ").append(sb.GetString()).append("\n");
+
+    strError.append("Invalid keyword: ").append(validator.GetInvalidSchemaKeyword()).append("\n");
+
+    sb.Clear();
+    validator.GetInvalidDocumentPointer().StringifyUriFragment(sb);
+    strError.append("Invalid document: ").append(sb.GetString());
+}
+
+static
+void format_parse_error(const rapidjson::ParseResult& result, std::string& strError)
+{
+    strError.append("Parse Json Error(offset ").append(std::to_string(result.Offset())).append("): ");
+    strError.append(rapidjson::GetParseError_En(result.Code()));
+}
+
+void CJsonSchema::GetError(const rapidjson::SchemaValidator& validator, std::string& strError)
+{
+    format_schema_error(validator, strError);
+}
+
+bool CJsonSchema::Validate(const rapidjson::Value& json) const
 {
     std::string strError;
     bool bRet = Validate(json, strError);
@@ -155,24 +279,233 @@ bool CJsonSchema::Validate(const rapidjson::Value& json)
     return bRet;
 }
 
-bool CJsonSchema::Validate(const rapidjson::Value& json, std::string& strError)
+bool CJsonSchema::Validate(const rapidjson::Value& json, std::string& strError) const
 {
-    m_validator.Reset();
-    bool bRet = json.Accept(m_validator);
+    rapidjson::SchemaValidator* validator = Acquire();
+    validator->Reset();
+    bool bRet = json.Accept(*validator);
     if (!bRet)
     {
-        rapidjson::StringBuffer sb;
-        m_validator.GetInvalidSchemaPointer().StringifyUriFragment(sb);
-        strError.append("Invalid schema: ").append(sb.GetString()).append("\n");
+        GetError(*validator, strError);
+    }
+
+    Release(validator);
+    return bRet;
+}
+
+bool CJsonSchema::ValidateArray(const rapidjson::Value& array, std::vector<schema_item_error_t>& errors,
+        int threads, bool stopEarly) const
+{
+    auto fn = [this](const rapidjson::Value& item, std::string& strError) {
+        return Validate(item, strError);
+    };
+    return validate_array(array, fn, errors, threads, stopEarly);
+}
+
+bool CJsonSchema::ValidateText(const char* json, size_t len, std::string& strError, rapidjson::Document* doc) const
+{
+    rapidjson::MemoryStream ms(json, len);
+    if (doc != NULL)
+    {
+        typedef rapidjson::SchemaValidatingReader<rapidjson::kParseDefaultFlags,
+                rapidjson::MemoryStream, rapidjson::UTF8<> > ValidatingReader;
+        ValidatingReader reader(ms, m_schema);
+        doc->Populate(reader);
+        if (!reader.IsValid())
+        {
+            format_schema_error(reader, strError);
+            return false;
+        }
+        if (reader.GetParseResult().IsError())
+        {
+            format_parse_error(reader.GetParseResult(), strError);
+            return false;
+        }
+        return true;
+    }
 
-        strError.append("Invalid keyword: ").append(m_validator.GetInvalidSchemaKeyword()).append("\n");
+    rapidjson::SchemaValidator* validator = Acquire();
+    validator->Reset();
+    rapidjson::Reader reader;
+    rapidjson::ParseResult result = reader.Parse(ms, *validator);
 
-        sb.Clear();
-        m_validator.GetInvalidDocumentPointer().StringifyUriFragment(sb);
-        strError.append("Invalid document: ").append(sb.GetString());
+    bool bRet = true;
+    if (!validator->IsValid())
+    {
+        GetError(*validator, strError);
+        bRet = false;
+    }
+    else if (result.IsError())
+    {
+        format_parse_error(result, strError);
+        bRet = false;
     }
 
+    Release(validator);
     return bRet;
 }
 
+/* ************************************************************ */
+// CSchemaRegistry
+
+static
+int64_t steady_millisecond()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// remote schema in the schema file is relative to its directory
+static
+std::string schema_basedir(const std::string& file)
+{
+    size_t pos = file.find_last_of("/\\");
+    if (pos == std::string::npos)
+    {
+        return "";
+    }
+    return file.substr(0, pos);
+}
+
+CSchemaRegistry& CSchemaRegistry::Instance()
+{
+    static CSchemaRegistry s_instance;
+    return s_instance;
+}
+
+bool CSchemaRegistry::Fresh(const std::string& file, const entry_t& entry)
+{
+    int64_t mtime = 0;
+    int64_t size = 0;
+    if (!file_stat(file, mtime, size) || mtime != entry.mtime || size != entry.size)
+    {
+        return false;
+    }
+    return entry.provider == nullptr || !entry.provider->Modified();
+}
+
+std::shared_ptr<const CJsonSchema> CSchemaRegistry::Get(const std::string& file)
+{
+    int64_t now = steady_millisecond();
+    entry_t entry;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_schema.find(file);
+        if (it != m_schema.end())
+        {
+            if (now - it->second.checkTime < CHECK_INTERVAL)
+            {
+                return it->second.schema;
+            }
+            entry = it->second;
+        }
+    }
+
+    // stat files out of lock, and compile out of lock as it may require
+    // remote schema from this registry
+    if (entry.schema && Fresh(file, entry))
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_schema.find(file);
+        if (it != m_schema.end() && it->second.schema == entry.schema)
+        {
+            it->second.checkTime = now;
+        }
+        return entry.schema;
+    }
+
+    entry_t fresh;
+    rapidjson::Document docSchema;
+    if (!file_stat(file, fresh.mtime, fresh.size) || !jsonkit::read_file(docSchema, file))
+    {
+        LOGF("Fail to read schema json file: %s", file.c_str());
+        return nullptr;
+    }
+
+    CSchemaProvider* provider = new CSchemaProvider(schema_basedir(file));
+    fresh.provider = provider;
+    fresh.schema = std::make_shared<CJsonSchema>(docSchema, provider);
+    fresh.checkTime = now;
+    LOGD("Compile schema json file: %s", file.c_str());
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_schema[file] = fresh;
+    return fresh.schema;
+}
+
+CSchemaRegistry::entry_t CSchemaRegistry::GetRemoteEntry(const std::string& file)
+{
+    int64_t now = steady_millisecond();
+    entry_t entry;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_remote.find(file);
+        if (it != m_remote.end())
+        {
+            if (now - it->second.checkTime < CHECK_INTERVAL)
+            {
+                return it->second;
+            }
+            entry = it->second;
+        }
+    }
+
+    if (entry.remote && Fresh(file, entry))
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_remote.find(file);
+        if (it != m_remote.end() && it->second.remote == entry.remote)
+        {
+            it->second.checkTime = now;
+        }
+        return entry;
+    }
+
+    entry_t fresh;
+    rapidjson::Document docSchema;
+    if (!file_stat(file, fresh.mtime, fresh.size) || !jsonkit::read_file(docSchema, file))
+    {
+        return fresh;
+    }
+
+    fresh.remote = std::make_shared<rapidjson::SchemaDocument>(docSchema);
+    fresh.checkTime = now;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_remote[file] = fresh;
+    return fresh;
+}
+
+std::shared_ptr<const rapidjson::SchemaDocument> CSchemaRegistry::GetRemote(const std::string& file)
+{
+    return GetRemoteEntry(file).remote;
+}
+
+void CSchemaRegistry::Clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_schema.clear();
+    m_remote.clear();
+}
+
+void CSchemaRegistry::Invalidate()
+{
+    int64_t expired = steady_millisecond() - CHECK_INTERVAL;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto& item : m_schema)
+    {
+        item.second.checkTime = expired;
+    }
+    for (auto& item : m_remote)
+    {
+        item.second.checkTime = expired;
+    }
+}
+
+size_t CSchemaRegistry::Size() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_schema.size() + m_remote.size();
+}
+
 } // end of namespace jsonkit
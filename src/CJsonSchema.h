@@ -9,11 +9,24 @@
 
 #include "rapidjson/document.h"
 #include "rapidjson/schema.h"
+#include "json_schema.h"
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
 
 namespace jsonkit
 {
 
-/// json schema support
+/** json schema support
+ * @details The SchemaDocument is compiled in constructor and is immutable
+ * after that, while the SchemaValidator that holds validating state is
+ * borrowed from a lock-free pool for each validation, and is reset and
+ * returned for reuse. So one CJsonSchema object can be shared and used by
+ * multiple threads at the same time without lock.
+ * */
 class CJsonSchema
 {
 public:
@@ -32,14 +45,124 @@ public:
     CJsonSchema(const rapidjson::Value& doc, const std::string& baseDir);
     ~CJsonSchema();
 
+    CJsonSchema(const CJsonSchema&) = delete;
+    CJsonSchema& operator=(const CJsonSchema&) = delete;
+
     /// validate json against this schema, may pass out error string
-    bool Validate(const rapidjson::Value& json);
-    bool Validate(const rapidjson::Value& json, std::string& strError);
+    bool Validate(const rapidjson::Value& json) const;
+    bool Validate(const rapidjson::Value& json, std::string& strError) const;
+
+    /// validate each item in array against this schema in parallel.
+    /// @see validate_array()
+    bool ValidateArray(const rapidjson::Value& array, std::vector<schema_item_error_t>& errors,
+            int threads = 0, bool stopEarly = false) const;
+
+    /** parse raw json text and validate against this schema in one pass.
+     * @param json, len: the raw json text
+     * @param [OUT] strError: the parse or validation error message if fail
+     * @param [OUT] doc: optional, build the DOM only when json is valid
+     * @details The parser feeds SAX events directly to the validator and
+     * stops at the first schema violation. When `doc` is null, the text is
+     * only validated by a pooled validator and no DOM is built at all.
+     * When `doc` is provided, it is populated only when both parse and
+     * validation success, otherwise keeps the old content.
+     * */
+    bool ValidateText(const char* json, size_t len, std::string& strError, rapidjson::Document* doc = NULL) const;
+
+    /// the compiled schema document, read only.
+    const rapidjson::SchemaDocument& Schema() const { return m_schema; }
+
+    /** borrow a validator from pool, or create a new one if pool is empty.
+     * @note The validator must be returned by Release() before this object
+     * is destroyed. It is not reset, the caller should call Reset() before
+     * using it.
+     * */
+    rapidjson::SchemaValidator* Acquire() const;
+
+    /// return a validator to pool, or delete it if pool is full.
+    void Release(rapidjson::SchemaValidator* validator) const;
+
+    /// format the error of a validator that fail to validate
+    static void GetError(const rapidjson::SchemaValidator& validator, std::string& strError);
 
 private:
     rapidjson::IRemoteSchemaDocumentProvider* m_provider;
     rapidjson::SchemaDocument m_schema;
-    rapidjson::SchemaValidator m_validator;
+
+    // one slot of pool, padded to its own cache line against false sharing
+    struct pool_slot_t
+    {
+        std::atomic<rapidjson::SchemaValidator*> validator;
+        char padding[64 - sizeof(std::atomic<rapidjson::SchemaValidator*>)];
+    };
+
+    // validators free to use, each slot is null or a validator
+    size_t m_poolSize;
+    std::unique_ptr<pool_slot_t[]> m_pool;
+};
+
+class CSchemaProvider;
+
+/** process-wide registry of compiled json schema from file.
+ * @details The compiled CJsonSchema is keyed by the schema file path, and
+ * the remote SchemaDocument refered by $ref is also cached and shared by all
+ * schema that refer to it. So repeated validation against the same schema
+ * file need not read file nor compile again.
+ * The cached schema is recompiled when the schema file or any remote $ref
+ * file it depends on is modified, which is checked by file mtime and size,
+ * at most once per CHECK_INTERVAL milliseconds.
+ * All methods are thread safe.
+ * */
+class CSchemaRegistry
+{
+public:
+    enum { CHECK_INTERVAL = 1000 };
+
+    /// the global instance
+    static CSchemaRegistry& Instance();
+
+    /** get the compiled schema of a schema file, with basedir of the file
+     * for its $ref.
+     * @return null if fail to read or compile the file.
+     * */
+    std::shared_ptr<const CJsonSchema> Get(const std::string& file);
+
+    /// get the remote schema document for $ref, null if fail to read.
+    std::shared_ptr<const rapidjson::SchemaDocument> GetRemote(const std::string& file);
+
+    /// drop all cached schema, the ones in use are still valid.
+    void Clear();
+
+    /** check the files of all cached schema on next Get(), without waiting
+     * for CHECK_INTERVAL, e.g. after deploy new schema files.
+     * */
+    void Invalidate();
+
+    /// the number of cached schema file, include remote ones.
+    size_t Size() const;
+
+private:
+    CSchemaRegistry() {}
+
+    struct entry_t
+    {
+        std::shared_ptr<const CJsonSchema> schema;
+        std::shared_ptr<const rapidjson::SchemaDocument> remote;
+        const CSchemaProvider* provider = nullptr; // owned by schema
+        int64_t mtime = 0;
+        int64_t size = 0;
+        int64_t checkTime = 0;
+    };
+
+    friend class CSchemaProvider;
+    entry_t GetRemoteEntry(const std::string& file);
+
+    // check if the cached entry is still up to date with the file
+    static bool Fresh(const std::string& file, const entry_t& entry);
+
+    mutable std::mutex m_mutex;
+    std::map<std::string, entry_t> m_schema;
+    std::map<std::string, entry_t> m_remote;
 };
 
 } // end of namespace jsonkit
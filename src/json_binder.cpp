@@ -0,0 +1,345 @@
+/**
+ * @file json_binder.cpp
+ * @author lymslive
+ * @date 2026-10-19
+ * @brief implement the SAX handler to bind json into C++ struct.
+ * */
+#include "json_binder.h"
+#include "jsonkit_internal.h"
+
+#include "rapidjson/reader.h"
+#include "rapidjson/memorystream.h"
+#include "rapidjson/error/en.h"
+
+namespace jsonkit
+{
+namespace impl
+{
+
+int CBindObject::Find(const char* key, size_t len, int hint) const
+{
+    int size = static_cast<int>(m_fields.size());
+    for (int i = 0; i < size; ++i)
+    {
+        int index = hint + i < size ? hint + i : hint + i - size;
+        const std::string& name = m_fields[index].name;
+        if (name.size() == len && memcmp(name.c_str(), key, len) == 0)
+        {
+            return index;
+        }
+    }
+    return -1;
+}
+
+bool CBindObject::AddField(bind_field_t&& field)
+{
+    if (m_fields.size() >= MAX_FIELD)
+    {
+        LOGF("too many fields to bind, ignore: %s", field.name.c_str());
+        return false;
+    }
+    if (field.required)
+    {
+        m_required |= (uint64_t(1) << m_fields.size());
+    }
+    m_fields.push_back(std::move(field));
+    return true;
+}
+
+const CBindType* CBindObject::Own(CBindType* type)
+{
+    m_owned.emplace_back(type);
+    return type;
+}
+
+/// SAX handler that route json value to the current target.
+class CBindHandler : public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, CBindHandler>
+{
+public:
+    CBindHandler(const CBindObject* root, void* object)
+        : m_root(root), m_object(object) {}
+
+    bool Null();
+    bool Bool(bool b);
+    bool Int(int i) { return Int64(i); }
+    bool Uint(unsigned u) { return Uint64(u); }
+    bool Int64(int64_t i);
+    bool Uint64(uint64_t u);
+    bool Double(double d);
+    bool String(const char* str, rapidjson::SizeType len, bool copy);
+    bool StartObject();
+    bool Key(const char* str, rapidjson::SizeType len, bool copy);
+    bool EndObject(rapidjson::SizeType memberCount);
+    bool StartArray();
+    bool EndArray(rapidjson::SizeType elementCount);
+
+    /// the error message if the handler stop parsing
+    const std::string& Error() const { return m_error; }
+    bool Failed() const { return m_failed; }
+
+private:
+    // open object or array that is binding
+    struct frame_t
+    {
+        const CBindType* type;
+        void* target;
+        int field;      // current field for object
+        size_t index;   // next index for array
+        uint64_t seen;  // present fields for object
+    };
+
+    // find the type and target for the next value, return false to skip it
+    bool Next(const CBindType*& type, void*& target);
+    // handle scalar value by the callback
+    template <typename fnT>
+    bool Scalar(fnT fn);
+    bool Fail(const char* skey, const char* sval);
+
+    const CBindObject* m_root;
+    void* m_object;
+    std::vector<frame_t> m_stack;
+    // depth of container skipped for unknown key
+    int m_skip = 0;
+    bool m_failed = false;
+    std::string m_error;
+};
+
+bool CBindHandler::Next(const CBindType*& type, void*& target)
+{
+    if (m_stack.empty())
+    {
+        type = m_root;
+        target = m_object;
+        return true;
+    }
+
+    frame_t& top = m_stack.back();
+    if (top.type->Kind() == BIND_ARRAY)
+    {
+        type = top.type->ElementType();
+        target = top.type->Element(top.target);
+        top.index++;
+        return true;
+    }
+
+    // value of unknown key in object
+    if (top.field < 0)
+    {
+        return false;
+    }
+    const CBindObject* object = static_cast<const CBindObject*>(top.type);
+    const bind_field_t& field = object->Field(top.field);
+    top.seen |= (uint64_t(1) << top.field);
+    type = field.type;
+    target = field.address(top.target);
+    return true;
+}
+
+// build the path from the stack only when fail, the message is in the same
+// format as validate_flat_schema()
+bool CBindHandler::Fail(const char* skey, const char* sval)
+{
+    m_failed = true;
+    m_error.append("INVALID ");
+    for (auto& frame : m_stack)
+    {
+        if (frame.type->Kind() == BIND_ARRAY)
+        {
+            // the element is appended before its value checked
+            m_error.append("/").append(std::to_string(frame.index - 1));
+        }
+        else if (frame.field >= 0)
+        {
+            const CBindObject* object = static_cast<const CBindObject*>(frame.type);
+            m_error.append("/").append(object->Field(frame.field).name);
+        }
+    }
+    m_error.append(" AGAINST ").append(skey).append(": ").append(sval);
+    return false;
+}
+
+template <typename fnT>
+bool CBindHandler::Scalar(fnT fn)
+{
+    if (m_skip > 0)
+    {
+        return true;
+    }
+    const CBindType* type = nullptr;
+    void* target = nullptr;
+    if (!Next(type, target))
+    {
+        return true;
+    }
+    if (!fn(type, target))
+    {
+        return Fail("type", type->Name());
+    }
+    return true;
+}
+
+bool CBindHandler::Null()
+{
+    if (m_skip > 0)
+    {
+        return true;
+    }
+    // null field is the same as not present
+    if (!m_stack.empty() && m_stack.back().type->Kind() == BIND_OBJECT)
+    {
+        frame_t& top = m_stack.back();
+        if (top.field >= 0)
+        {
+            top.seen &= ~(uint64_t(1) << top.field);
+        }
+        return true;
+    }
+    return Scalar([](const CBindType*, void*) { return false; });
+}
+
+bool CBindHandler::Bool(bool b)
+{
+    return Scalar([b](const CBindType* type, void* target) { return type->Bool(target, b); });
+}
+
+bool CBindHandler::Int64(int64_t i)
+{
+    return Scalar([i](const CBindType* type, void* target) { return type->Int64(target, i); });
+}
+
+bool CBindHandler::Uint64(uint64_t u)
+{
+    return Scalar([u](const CBindType* type, void* target) { return type->Uint64(target, u); });
+}
+
+bool CBindHandler::Double(double d)
+{
+    return Scalar([d](const CBindType* type, void* target) { return type->Double(target, d); });
+}
+
+bool CBindHandler::String(const char* str, rapidjson::SizeType len, bool copy)
+{
+    return Scalar([str, len](const CBindType* type, void* target) { return type->String(target, str, len); });
+}
+
+bool CBindHandler::StartObject()
+{
+    if (m_skip > 0)
+    {
+        m_skip++;
+        return true;
+    }
+    const CBindType* type = nullptr;
+    void* target = nullptr;
+    if (!Next(type, target))
+    {
+        m_skip = 1;
+        return true;
+    }
+    if (type->Kind() != BIND_OBJECT)
+    {
+        return Fail("type", type->Name());
+    }
+    m_stack.push_back(frame_t{type, target, -1, 0, 0});
+    return true;
+}
+
+bool CBindHandler::Key(const char* str, rapidjson::SizeType len, bool copy)
+{
+    if (m_skip > 0)
+    {
+        return true;
+    }
+    frame_t& top = m_stack.back();
+    const CBindObject* object = static_cast<const CBindObject*>(top.type);
+    top.field = object->Find(str, len, top.field + 1);
+    return true;
+}
+
+bool CBindHandler::EndObject(rapidjson::SizeType memberCount)
+{
+    if (m_skip > 0)
+    {
+        m_skip--;
+        return true;
+    }
+    frame_t& top = m_stack.back();
+    const CBindObject* object = static_cast<const CBindObject*>(top.type);
+    uint64_t lack = object->RequiredMask() & ~top.seen;
+    if (lack != 0)
+    {
+        // report the first missing field
+        int index = 0;
+        while ((lack & (uint64_t(1) << index)) == 0)
+        {
+            ++index;
+        }
+        top.field = index;
+        return Fail("required", "true");
+    }
+    m_stack.pop_back();
+    return true;
+}
+
+bool CBindHandler::StartArray()
+{
+    if (m_skip > 0)
+    {
+        m_skip++;
+        return true;
+    }
+    const CBindType* type = nullptr;
+    void* target = nullptr;
+    if (!Next(type, target))
+    {
+        m_skip = 1;
+        return true;
+    }
+    if (type->Kind() != BIND_ARRAY)
+    {
+        return Fail("type", type->Name());
+    }
+    type->Clear(target);
+    m_stack.push_back(frame_t{type, target, -1, 0, 0});
+    return true;
+}
+
+bool CBindHandler::EndArray(rapidjson::SizeType elementCount)
+{
+    if (m_skip > 0)
+    {
+        m_skip--;
+        return true;
+    }
+    m_stack.pop_back();
+    return true;
+}
+
+bool CBindObject::Bind(const char* json, size_t len, void* object, std::string* error) const
+{
+    CBindHandler handler(this, object);
+    rapidjson::Reader reader;
+    rapidjson::MemoryStream ms(json, len);
+    rapidjson::ParseResult result = reader.Parse(ms, handler);
+    if (!result.IsError())
+    {
+        return true;
+    }
+
+    if (error != nullptr)
+    {
+        if (handler.Failed())
+        {
+            error->append(handler.Error());
+        }
+        else
+        {
+            error->append("Parse Json Error(offset ").append(std::to_string(result.Offset())).append("): ");
+            error->append(rapidjson::GetParseError_En(result.Code()));
+        }
+    }
+    return false;
+}
+
+} /* impl */
+} /* jsonkit */
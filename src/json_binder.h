@@ -0,0 +1,354 @@
+/**
+ * @file json_binder.h
+ * @author lymslive
+ * @date 2026-10-19
+ * @brief parse json text directly into C++ struct with type check.
+ * @details
+ * The usual way to get a struct from json text is `read_string()` to DOM,
+ * then `validate_flat_schema()`, then extract each field by `operator|`.
+ * CJsonBinder combines these three steps in one pass: the SAX events from
+ * the parser are routed to the struct members by a field table, the type of
+ * each value is checked when it is tokenized, unknown keys are skipped
+ * without building anything, and missing required fields are checked at
+ * the end of each object.
+ * */
+#ifndef JSON_BINDER_H__
+#define JSON_BINDER_H__
+
+#include <stdint.h>
+#include <string.h>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace jsonkit
+{
+
+namespace impl
+{
+
+enum bind_kind_t
+{
+    BIND_SCALAR = 0,
+    BIND_ARRAY,
+    BIND_OBJECT,
+};
+
+/** how to store a json value to the C++ object at `target`.
+ * @details Each method return false if the json type is not acceptable.
+ * */
+class CBindType
+{
+public:
+    virtual ~CBindType() {}
+    virtual bind_kind_t Kind() const { return BIND_SCALAR; }
+    /// type name used in error message
+    virtual const char* Name() const = 0;
+
+    virtual bool Bool(void* target, bool b) const { return false; }
+    virtual bool Int64(void* target, int64_t i) const { return false; }
+    virtual bool Uint64(void* target, uint64_t u) const { return false; }
+    virtual bool Double(void* target, double d) const { return false; }
+    virtual bool String(void* target, const char* str, size_t len) const { return false; }
+
+    /// array: clear the container before the first element
+    virtual void Clear(void* target) const {}
+    /// array: append a new element and return its address
+    virtual void* Element(void* target) const { return nullptr; }
+    /// array: the type of element
+    virtual const CBindType* ElementType() const { return nullptr; }
+};
+
+/// one member field of struct
+struct bind_field_t
+{
+    std::string name;
+    bool required;
+    const CBindType* type;
+    std::function<void*(void*)> address;
+};
+
+/** the non-template part of struct binder.
+ * @details At most 64 fields for each struct, as the present fields are
+ * tracked by a bitmask.
+ * */
+class CBindObject : public CBindType
+{
+public:
+    enum { MAX_FIELD = 64 };
+
+    bind_kind_t Kind() const override { return BIND_OBJECT; }
+    const char* Name() const override { return "object"; }
+
+    /** find field by key name, try `hint` first as keys usually come in
+     * the same order as fields declared.
+     * @return index of field, or -1 if unknown key
+     * */
+    int Find(const char* key, size_t len, int hint) const;
+
+    const bind_field_t& Field(int index) const { return m_fields[index]; }
+    uint64_t RequiredMask() const { return m_required; }
+
+    /** parse json text into the struct at `object`.
+     * @param [OUT] error: if not null, save error message on fail
+     * */
+    bool Bind(const char* json, size_t len, void* object, std::string* error) const;
+
+protected:
+    bool AddField(bind_field_t&& field);
+    const CBindType* Own(CBindType* type);
+
+private:
+    std::vector<bind_field_t> m_fields;
+    uint64_t m_required = 0;
+    std::vector<std::unique_ptr<CBindType>> m_owned;
+};
+
+template <typename T>
+class CBindInteger : public CBindType
+{
+public:
+    const char* Name() const override { return "integer"; }
+    bool Int64(void* target, int64_t i) const override
+    {
+        T value = static_cast<T>(i);
+        if (static_cast<int64_t>(value) != i || (value < 0) != (i < 0))
+        {
+            return false;
+        }
+        *static_cast<T*>(target) = value;
+        return true;
+    }
+    bool Uint64(void* target, uint64_t u) const override
+    {
+        T value = static_cast<T>(u);
+        if (static_cast<uint64_t>(value) != u || value < 0)
+        {
+            return false;
+        }
+        *static_cast<T*>(target) = value;
+        return true;
+    }
+};
+
+template <typename T>
+class CBindFloat : public CBindType
+{
+public:
+    const char* Name() const override { return "number"; }
+    bool Int64(void* target, int64_t i) const override
+    {
+        *static_cast<T*>(target) = static_cast<T>(i);
+        return true;
+    }
+    bool Uint64(void* target, uint64_t u) const override
+    {
+        *static_cast<T*>(target) = static_cast<T>(u);
+        return true;
+    }
+    bool Double(void* target, double d) const override
+    {
+        *static_cast<T*>(target) = static_cast<T>(d);
+        return true;
+    }
+};
+
+class CBindBool : public CBindType
+{
+public:
+    const char* Name() const override { return "bool"; }
+    bool Bool(void* target, bool b) const override
+    {
+        *static_cast<bool*>(target) = b;
+        return true;
+    }
+};
+
+class CBindString : public CBindType
+{
+public:
+    const char* Name() const override { return "string"; }
+    bool String(void* target, const char* str, size_t len) const override
+    {
+        static_cast<std::string*>(target)->assign(str, len);
+        return true;
+    }
+};
+
+template <typename T>
+class CBindVector : public CBindType
+{
+public:
+    CBindVector(const CBindType* element) : m_element(element) {}
+
+    bind_kind_t Kind() const override { return BIND_ARRAY; }
+    const char* Name() const override { return "array"; }
+
+    void Clear(void* target) const override
+    {
+        static_cast<std::vector<T>*>(target)->clear();
+    }
+    void* Element(void* target) const override
+    {
+        std::vector<T>* vec = static_cast<std::vector<T>*>(target);
+        vec->emplace_back();
+        return &vec->back();
+    }
+    const CBindType* ElementType() const override { return m_element; }
+
+private:
+    const CBindType* m_element;
+};
+
+/// element of std::vector<bool> appended when its value is known, as the
+/// packed bits cannot be addressed
+class CBindBoolElement : public CBindType
+{
+public:
+    const char* Name() const override { return "bool"; }
+    bool Bool(void* target, bool b) const override
+    {
+        static_cast<std::vector<bool>*>(target)->push_back(b);
+        return true;
+    }
+};
+
+/// std::vector<bool>, the element target is the vector itself
+class CBindBoolVector : public CBindType
+{
+public:
+    bind_kind_t Kind() const override { return BIND_ARRAY; }
+    const char* Name() const override { return "array"; }
+
+    void Clear(void* target) const override
+    {
+        static_cast<std::vector<bool>*>(target)->clear();
+    }
+    void* Element(void* target) const override { return target; }
+    const CBindType* ElementType() const override
+    {
+        static CBindBoolElement s_element;
+        return &s_element;
+    }
+};
+
+/// get the singleton bind type for scalar member and vector of scalar
+template <typename T> struct bind_traits;
+
+#define BIND_TRAITS(T, BindClass) \
+template <> struct bind_traits<T> \
+{ \
+    static const CBindType* Type() { static BindClass s_type; return &s_type; } \
+}
+
+BIND_TRAITS(bool, CBindBool);
+BIND_TRAITS(int, CBindInteger<int>);
+BIND_TRAITS(unsigned, CBindInteger<unsigned>);
+BIND_TRAITS(int64_t, CBindInteger<int64_t>);
+BIND_TRAITS(uint64_t, CBindInteger<uint64_t>);
+BIND_TRAITS(float, CBindFloat<float>);
+BIND_TRAITS(double, CBindFloat<double>);
+BIND_TRAITS(std::string, CBindString);
+#undef BIND_TRAITS
+
+template <typename T> struct bind_traits<std::vector<T>>
+{
+    static const CBindType* Type()
+    {
+        static CBindVector<T> s_type(bind_traits<T>::Type());
+        return &s_type;
+    }
+};
+
+template <> struct bind_traits<std::vector<bool>>
+{
+    static const CBindType* Type() { static CBindBoolVector s_type; return &s_type; }
+};
+
+} /* impl */
+
+/** bind json object to C++ struct T.
+ * @details Declare the member fields once, then parse many json text.
+ * Supported member types are bool, int, unsigned, int64_t, uint64_t,
+ * float, double, std::string, std::vector of them, and nested struct or
+ * vector of struct with their own binder.
+ * - Integer member accepts only json integer in its range.
+ * - Float member accepts any json number.
+ * - Null value is treated as the key not present.
+ * - Unknown keys are skipped, the member not present in json keeps its
+ *   old value.
+ * - A failed Parse leaves the struct partly overwritten.
+ * The binder is read only after fields declared, so can be shared by
+ * threads. A nested binder is refered by pointer, it should outlive the
+ * binder using it.
+ * @code
+ *   struct Item { int id; std::string name; std::vector<int> tags; };
+ *   jsonkit::CJsonBinder<Item> binder;
+ *   binder.Field("id", &Item::id, true).Field("name", &Item::name).Field("tags", &Item::tags);
+ *   Item item;
+ *   std::string error;
+ *   if (!binder.Parse(text, item, &error)) { ... }
+ * @endcode
+ * */
+template <typename T>
+class CJsonBinder : public impl::CBindObject
+{
+public:
+    /// bind a scalar member or vector of scalar
+    template <typename M>
+    CJsonBinder& Field(const char* name, M T::*member, bool required = false)
+    {
+        AddField(impl::bind_field_t{name, required, impl::bind_traits<M>::Type(), Address(member)});
+        return *this;
+    }
+
+    /// bind a nested struct member
+    template <typename M>
+    CJsonBinder& Field(const char* name, M T::*member, const CJsonBinder<M>& binder, bool required = false)
+    {
+        AddField(impl::bind_field_t{name, required, &binder, Address(member)});
+        return *this;
+    }
+
+    /// bind a vector of nested struct member
+    template <typename M>
+    CJsonBinder& Field(const char* name, std::vector<M> T::*member, const CJsonBinder<M>& binder, bool required = false)
+    {
+        const impl::CBindType* type = Own(new impl::CBindVector<M>(&binder));
+        AddField(impl::bind_field_t{name, required, type, Address(member)});
+        return *this;
+    }
+
+    /** parse json text that should be an object into `object`.
+     * @param json, len: the json text
+     * @param [OUT] object: the struct to fill
+     * @param [OUT] error: if not null, save the error message on fail
+     * @return false if the text is not well-formed json, not match the
+     * member types, or lack of required field.
+     * @note The members are stored as the values are parsed, so on fail
+     * `object` is left partly overwritten, parse into a fresh copy if the
+     * old value should be kept.
+     * */
+    bool Parse(const char* json, size_t len, T& object, std::string* error = nullptr) const
+    {
+        return Bind(json, len, &object, error);
+    }
+
+    bool Parse(const std::string& json, T& object, std::string* error = nullptr) const
+    {
+        return Bind(json.c_str(), json.size(), &object, error);
+    }
+
+private:
+    template <typename M>
+    static std::function<void*(void*)> Address(M T::*member)
+    {
+        return [member](void* object) -> void* { return &(static_cast<T*>(object)->*member); };
+    }
+};
+
+} /* jsonkit */
+
+#endif /* end of include guard: JSON_BINDER_H__ */
@@ -6,11 +6,16 @@
  * */
 
 #include <algorithm>
+#include <memory>
 #include <regex>
 
 #include "json_filter.h"
 #include "json_output.h"
 #include "json_input.h"
+#include "json_operator.h"
+
+#include "rapidjson/reader.h"
+#include "rapidjson/memorystream.h"
 
 namespace jsonkit
 {
@@ -21,22 +26,6 @@ bool keep_bool(bool keep, bool tf)
     return keep ? tf : !tf;
 }
 
-inline
-bool filter_fn_null(const rapidjson::Value& name, const rapidjson::Value& value)
-{
-    return !value.IsNull();
-}
-
-inline
-bool filter_fn_empty(const rapidjson::Value& name, const rapidjson::Value& value)
-{
-    return !(value.IsNull()
-            || (value.IsString() && value.GetStringLength() == 0)
-            || (value.IsArray() && value.Empty())
-            || (value.IsObject() && value.ObjectEmpty())
-            );
-}
-
 class CFilterKey
 {
 public:
@@ -75,59 +64,108 @@ private:
 
 int json_filter(rapidjson::Value& json, json_filter_fn fn)
 {
-    int count = 0;
+    return impl::json_filter_internal(json, fn);
+}
+
+int filter_null(rapidjson::Value& json)
+{
+    return json_filter(json,
+            [](const rapidjson::Value& name, const rapidjson::Value& value)
+            {
+                return filter_fn_null(name, value);
+            });
+}
+
+int filter_empty(rapidjson::Value& json)
+{
+    return json_filter(json,
+            [](const rapidjson::Value& name, const rapidjson::Value& value)
+            {
+                return filter_fn_empty(name, value);
+            });
+}
+
+static bool remove_empty(rapidjson::Value& json, empty_count_t& count);
+
+// remove empty children of json object or array, post-order
+static void remove_empty_children(rapidjson::Value& json, empty_count_t& count)
+{
     if (json.IsObject())
     {
         for (auto it = json.MemberBegin(); it != json.MemberEnd(); )
         {
-            if (fn(it->name, it->value))
+            if (remove_empty(it->value, count))
             {
-                if (it->value.IsObject() || it->value.IsArray())
-                {
-                    count += json_filter(it->value, fn);
-                }
-                ++it;
+                it = json.RemoveMember(it);
             }
             else
             {
-                // swap the last to current iterator, not ++ step forward
-                it = json.RemoveMember(it);
-                ++count;
+                ++it;
             }
         }
     }
     else if (json.IsArray())
     {
-        rapidjson::Value nullVal;
         for (auto it = json.Begin(); it != json.End(); )
         {
-            if (fn(nullVal, *it))
+            if (remove_empty(*it, count))
             {
-                if (it->IsObject() || it->IsArray())
-                {
-                    count += json_filter(*it, fn);
-                }
-                ++it;
+                it = json.Erase(it);
             }
             else
             {
-                // move the left forward, not ++ step
-                it = json.Erase(it);
-                ++count;
+                ++it;
             }
         }
     }
-    return count;
 }
 
-int filter_null(rapidjson::Value& json)
+// return true if json is empty after remove its children, and count it
+static bool remove_empty(rapidjson::Value& json, empty_count_t& count)
 {
-    return json_filter(json, filter_fn_null);
+    if (json.IsNull())
+    {
+        ++count.null_value;
+        return true;
+    }
+    else if (json.IsString())
+    {
+        if (json.GetStringLength() == 0)
+        {
+            ++count.empty_string;
+            return true;
+        }
+    }
+    else if (json.IsObject())
+    {
+        remove_empty_children(json, count);
+        if (json.ObjectEmpty())
+        {
+            ++count.empty_object;
+            return true;
+        }
+    }
+    else if (json.IsArray())
+    {
+        remove_empty_children(json, count);
+        if (json.Empty())
+        {
+            ++count.empty_array;
+            return true;
+        }
+    }
+    return false;
 }
 
-int filter_empty(rapidjson::Value& json)
+int filter_empty_recursive(rapidjson::Value& json, empty_count_t* count/* = nullptr*/)
 {
-    return json_filter(json, filter_fn_empty);
+    empty_count_t local;
+    remove_empty_children(json, local);
+    if (count)
+    {
+        *count = local;
+    }
+    return local.total();
 }
 
 int filter_key(rapidjson::Value& json, const std::vector<std::string>& keys, bool keep/* = true*/)
@@ -169,40 +207,39 @@ int filter_key(rapidjson::Value& json, const std::string& pattern, bool keep/* =
 
 void map_replace(rapidjson::Value& json, rapidjson::Document::AllocatorType& allocator, json_map_fn fn)
 {
-    if (json.IsObject())
+    impl::map_replace_internal(json, allocator, fn);
+}
+
+void map_fn_to_string(rapidjson::Value& name, rapidjson::Value& value, rapidjson::Document::AllocatorType& allocator)
+{
+    if (value.IsString())
     {
-        for (auto it = json.MemberBegin(); it != json.MemberEnd(); ++it)
-        {
-            if (it->value.IsObject() || it->value.IsArray())
-            {
-                map_replace(it->value, allocator, fn);
-            }
-            else
-            {
-                fn(it->name, it->value, allocator);
-            }
-        }
+        return;
     }
-    else if (json.IsArray())
+
+    // constant string literal, no copy at all
+    if (value.IsNull())
     {
-        rapidjson::Value nullName;
-        for (auto it = json.Begin(); it != json.End(); ++it)
-        {
-            if (it->IsObject() || it->IsArray())
-            {
-                map_replace(*it, allocator, fn);
-            }
-            else
-            {
-                fn(nullName, *it, allocator);
-            }
-        }
+        value.SetString(rapidjson::StringRef("null"));
+        return;
     }
-    else
+    if (value.IsBool())
     {
-        rapidjson::Value nullName;
-        fn(nullName, json, allocator);
+        value.SetString(value.GetBool() ? rapidjson::StringRef("true") : rapidjson::StringRef("false"));
+        return;
+    }
+
+    // most number is short string saved inline, otherwise copy to allocator
+    char buffer[32];
+    size_t len = format_number(value, buffer);
+    if (len > 0)
+    {
+        value.SetString(buffer, len, allocator);
+        return;
     }
+
+    std::string str = stringfy(value);
+    value.SetString(str.c_str(), str.size(), allocator);
 }
 
 void map_to_string(rapidjson::Value& json, rapidjson::Document::AllocatorType& allocator)
@@ -210,13 +247,8 @@ void map_to_string(rapidjson::Value& json, rapidjson::Document::AllocatorType& a
     map_replace(json, allocator,
             [](rapidjson::Value& name, rapidjson::Value& value, rapidjson::Document::AllocatorType& allocator)
             {
-                if (!value.IsString())
-                {
-                    std::string str = stringfy(value);
-                    value.SetString(str.c_str(), str.size(), allocator);
-                }
-            }
-        );
+                map_fn_to_string(name, value, allocator);
+            });
 }
 
 void map_fn_decode_json(rapidjson::Value& name, rapidjson::Value& value, rapidjson::Document::AllocatorType& allocator)
@@ -246,7 +278,274 @@ void map_fn_decode_json(rapidjson::Value& name, rapidjson::Value& value, rapidjs
 
 void map_decode_json(rapidjson::Value& json, rapidjson::Document::AllocatorType& allocator)
 {
-    map_replace(json, allocator, map_fn_decode_json);
+    map_replace(json, allocator,
+            [](rapidjson::Value& name, rapidjson::Value& value, rapidjson::Document::AllocatorType& allocator)
+            {
+                map_fn_decode_json(name, value, allocator);
+            });
+}
+
+/* ************************************************************ */
+// Section: lazy decode
+
+inline
+bool maybe_json_text(const char* str, size_t len)
+{
+    if (str == nullptr || len < 2)
+    {
+        return false;
+    }
+    const char b = str[0];
+    const char e = str[len-1];
+    return (b == '{' && e == '}') || (b == '[' && e == ']');
+}
+
+bool is_json_text(const char* str, size_t len)
+{
+    if (!maybe_json_text(str, len))
+    {
+        return false;
+    }
+
+    // the parser stack is in this buffer, unless deeply nested or long string
+    char buffer[1024];
+    rapidjson::MemoryPoolAllocator<> stackAllocator(buffer, sizeof(buffer));
+    rapidjson::GenericReader<rapidjson::UTF8<>, rapidjson::UTF8<>, rapidjson::MemoryPoolAllocator<>> reader(&stackAllocator, 256);
+    rapidjson::BaseReaderHandler<> handler;
+    rapidjson::MemoryStream is(str, len);
+    return !reader.Parse(is, handler).IsError();
+}
+
+const rapidjson::Value& CLazyJson::Decode(const rapidjson::Value& value)
+{
+    if (!value.IsString() || !maybe_json_text(value.GetString(), value.GetStringLength()))
+    {
+        return value;
+    }
+
+    auto it = m_memo.find(&value);
+    if (it == m_memo.end())
+    {
+        // parse only once, remember null for invalid json, which is
+        // rejected by SAX scan without allocating the document
+        std::unique_ptr<rapidjson::Document> doc;
+        if (is_json_text(value.GetString(), value.GetStringLength()))
+        {
+            doc.reset(new rapidjson::Document);
+            doc->Parse(value.GetString(), value.GetStringLength());
+            if (doc->HasParseError())
+            {
+                doc.reset();
+            }
+        }
+        it = m_memo.emplace(&value, std::move(doc)).first;
+    }
+    return it->second ? *(it->second) : value;
+}
+
+const rapidjson::Value& CLazyJson::Path(const rapidjson::Value& node, const char* path)
+{
+    const rapidjson::Value* current = &Decode(node);
+    if (path == nullptr || path[0] == '\0')
+    {
+        return operate_path(*current, path);
+    }
+
+    // the whole path may be a key, the same as operator/
+    if (current->IsObject() && current->HasMember(path))
+    {
+        return Decode((*current)[path]);
+    }
+
+    std::string key;
+    for (const char* head = path; ; ++head)
+    {
+        if (*head != '/' && *head != '\0')
+        {
+            key.push_back(*head);
+            continue;
+        }
+        if (!key.empty())
+        {
+            current = &Decode(operate_path(*current, key));
+            key.clear();
+        }
+        if (*head == '\0')
+        {
+            break;
+        }
+    }
+    return *current;
+}
+
+const rapidjson::Value& CLazyJson::Index(const rapidjson::Value& node, size_t index)
+{
+    return Decode(operate_path(Decode(node), index));
+}
+
+/* ************************************************************ */
+// Section: pipeline
+
+CJsonPipeline& CJsonPipeline::Filter(json_filter_fn fn)
+{
+    Stage stage;
+    stage.filter = fn;
+    m_stages.push_back(stage);
+    return *this;
+}
+
+CJsonPipeline& CJsonPipeline::Map(json_map_fn fn)
+{
+    Stage stage;
+    stage.map = fn;
+    m_stages.push_back(stage);
+    return *this;
+}
+
+CJsonPipeline& CJsonPipeline::FilterNull()
+{
+    return Filter(filter_fn_null);
+}
+
+CJsonPipeline& CJsonPipeline::FilterEmpty()
+{
+    return Filter(filter_fn_empty);
+}
+
+CJsonPipeline& CJsonPipeline::FilterKey(const std::vector<std::string>& keys, bool keep/* = true*/)
+{
+    if (keys.size() >= 4)
+    {
+        std::vector<std::string> keysort(keys);
+        std::sort(keysort.begin(), keysort.end());
+        return Filter(CFilterKey(keysort, true, keep));
+    }
+    return Filter(CFilterKey(keys, false, keep));
+}
+
+CJsonPipeline& CJsonPipeline::FilterKey(const std::string& pattern, bool keep/* = true*/)
+{
+    // share the compiled regex among copies of the filter function
+    std::shared_ptr<std::regex> exp = std::make_shared<std::regex>(pattern);
+    return Filter([exp, keep](const rapidjson::Value& name, const rapidjson::Value& value)
+            {
+                if (!name.IsString())
+                {
+                    return true;
+                }
+                std::string key = name.GetString();
+                bool match = std::regex_search(key, *exp);
+                return keep_bool(keep, match);
+            });
+}
+
+CJsonPipeline& CJsonPipeline::MapToString()
+{
+    return Map(map_fn_to_string);
+}
+
+CJsonPipeline& CJsonPipeline::MapDecodeJson()
+{
+    return Map(map_fn_decode_json);
+}
+
+bool CJsonPipeline::DoFilter(rapidjson::Value& name, rapidjson::Value& value, rapidjson::Document::AllocatorType& allocator) const
+{
+    for (auto& stage : m_stages)
+    {
+        if (stage.filter)
+        {
+            if (!stage.filter(name, value))
+            {
+                return false;
+            }
+        }
+        else if (stage.map && !value.IsObject() && !value.IsArray())
+        {
+            stage.map(name, value, allocator);
+        }
+    }
+    return true;
+}
+
+inline
+bool empty_container(const rapidjson::Value& json)
+{
+    return (json.IsObject() && json.ObjectEmpty()) || (json.IsArray() && json.Empty());
+}
+
+int CJsonPipeline::DoRun(rapidjson::Value& json, rapidjson::Document::AllocatorType& allocator) const
+{
+    int count = 0;
+    if (json.IsObject())
+    {
+        for (auto it = json.MemberBegin(); it != json.MemberEnd(); )
+        {
+            bool container = it->value.IsObject() || it->value.IsArray();
+            bool keep = DoFilter(it->name, it->value, allocator);
+            if (keep && container)
+            {
+                count += DoRun(it->value, allocator);
+                keep = !(m_removeEmpty && empty_container(it->value));
+            }
+
+            if (keep)
+            {
+                ++it;
+            }
+            else
+            {
+                // swap the last to current iterator, not ++ step forward
+                it = json.RemoveMember(it);
+                ++count;
+            }
+        }
+    }
+    else if (json.IsArray())
+    {
+        rapidjson::Value nullName;
+        for (auto it = json.Begin(); it != json.End(); )
+        {
+            bool container = it->IsObject() || it->IsArray();
+            bool keep = DoFilter(nullName, *it, allocator);
+            if (keep && container)
+            {
+                count += DoRun(*it, allocator);
+                keep = !(m_removeEmpty && empty_container(*it));
+            }
+
+            if (keep)
+            {
+                ++it;
+            }
+            else
+            {
+                // move the left forward, not ++ step
+                it = json.Erase(it);
+                ++count;
+            }
+        }
+    }
+    return count;
+}
+
+int CJsonPipeline::Run(rapidjson::Value& json, rapidjson::Document::AllocatorType& allocator) const
+{
+    if (json.IsObject() || json.IsArray())
+    {
+        return DoRun(json, allocator);
+    }
+
+    // scalar root can only be mapped, not removed
+    rapidjson::Value nullName;
+    for (auto& stage : m_stages)
+    {
+        if (stage.map && !json.IsObject() && !json.IsArray())
+        {
+            stage.map(nullName, json, allocator);
+        }
+    }
+    return 0;
 }
 
 } /* jsonkit */ 
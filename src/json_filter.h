@@ -8,7 +8,9 @@
 #define JSON_FILTER_H__
 
 #include <functional>
+#include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 #include "rapidjson/document.h"
 
@@ -38,6 +40,90 @@ typedef std::function<bool(const rapidjson::Value& name, const rapidjson::Value&
  * */
 int json_filter(rapidjson::Value& json, json_filter_fn fn);
 
+namespace impl
+{
+
+template <typename Pred>
+int json_filter_internal(rapidjson::Value& json, Pred& pred)
+{
+    int count = 0;
+    if (json.IsObject())
+    {
+        for (auto it = json.MemberBegin(); it != json.MemberEnd(); )
+        {
+            if (pred(it->name, it->value))
+            {
+                if (it->value.IsObject() || it->value.IsArray())
+                {
+                    count += json_filter_internal(it->value, pred);
+                }
+                ++it;
+            }
+            else
+            {
+                // swap the last to current iterator, not ++ step forward
+                it = json.RemoveMember(it);
+                ++count;
+            }
+        }
+    }
+    else if (json.IsArray())
+    {
+        rapidjson::Value nullVal;
+        for (auto it = json.Begin(); it != json.End(); )
+        {
+            if (pred(nullVal, *it))
+            {
+                if (it->IsObject() || it->IsArray())
+                {
+                    count += json_filter_internal(*it, pred);
+                }
+                ++it;
+            }
+            else
+            {
+                // move the left forward, not ++ step
+                it = json.Erase(it);
+                ++count;
+            }
+        }
+    }
+    return count;
+}
+
+} /* impl */
+
+/** filter a json dom with any callable predicate
+ * @details The same as above, but the predicate is a template parameter, so
+ * that a lambda or functor object can be inlined into the traversal, avoid
+ * the indirect call of `std::function` for each node. A plain function is
+ * passed as pointer, wrap it in a lambda to be inlined.
+ * The predicate is passed by reference in recursion, not copied.
+ * */
+template <typename Pred>
+int json_filter(rapidjson::Value& json, Pred pred)
+{
+    return impl::json_filter_internal(json, pred);
+}
+
+/** pre-defined filter predicate, reserve not null value */
+inline
+bool filter_fn_null(const rapidjson::Value& name, const rapidjson::Value& value)
+{
+    return !value.IsNull();
+}
+
+/** pre-defined filter predicate, reserve not empty value */
+inline
+bool filter_fn_empty(const rapidjson::Value& name, const rapidjson::Value& value)
+{
+    return !(value.IsNull()
+            || (value.IsString() && value.GetStringLength() == 0)
+            || (value.IsArray() && value.Empty())
+            || (value.IsObject() && value.ObjectEmpty())
+            );
+}
+
 /** filter out null value
  * @param json, the json tree to filtered
  * @return the number of removed null value
@@ -49,8 +135,8 @@ int filter_null(rapidjson::Value& json);
  * @return the number of removed empty value
  * @details Including empty string "", empty array [], empty object {}, and
  * null value. But zero number and false is thought as meaningfull and kept.
- * @note Can only filter out one direct layer empty, not recursively, you can
- * manually use `while(filter_empty(json))` if really needed. For example:
+ * @note Can only filter out one direct layer empty, not recursively, use
+ * @ref filter_empty_recursive() if really needed. For example:
  * @code
  * { "aaa": 1, "bbb": [null, "", [], {}] }
  * # call filter_emplty() one time result in
@@ -61,6 +147,31 @@ int filter_null(rapidjson::Value& json);
  * */
 int filter_empty(rapidjson::Value& json);
 
+/** the number of removed empty value in each kind */
+struct empty_count_t
+{
+    int null_value = 0;
+    int empty_string = 0;
+    int empty_array = 0;
+    int empty_object = 0;
+
+    int total() const
+    {
+        return null_value + empty_string + empty_array + empty_object;
+    }
+};
+
+/** filter out empty json value recursively in one pass
+ * @param json, the json tree to filtered
+ * @param count, optionally output the number of removed value in each kind
+ * @return the number of removed empty value
+ * @details The same empty value as @ref filter_empty(), but remove bottom
+ * up, the array or object become empty after its children removed is also
+ * removed, so only one traversal is needed no matter how deep it nests.
+ * The root json itself is not removed even if it become empty.
+ * */
+int filter_empty_recursive(rapidjson::Value& json, empty_count_t* count = nullptr);
+
 /** filter json object with a list of keys
  * @param json, the json to filtered
  * @param keys, the list of keys interested 
@@ -100,6 +211,60 @@ typedef std::function<void(rapidjson::Value& name, rapidjson::Value& value, rapi
  * */
 void map_replace(rapidjson::Value& json, rapidjson::Document::AllocatorType& allocator, json_map_fn fn);
 
+namespace impl
+{
+
+template <typename Fn>
+void map_replace_internal(rapidjson::Value& json, rapidjson::Document::AllocatorType& allocator, Fn& fn)
+{
+    if (json.IsObject())
+    {
+        for (auto it = json.MemberBegin(); it != json.MemberEnd(); ++it)
+        {
+            if (it->value.IsObject() || it->value.IsArray())
+            {
+                map_replace_internal(it->value, allocator, fn);
+            }
+            else
+            {
+                fn(it->name, it->value, allocator);
+            }
+        }
+    }
+    else if (json.IsArray())
+    {
+        rapidjson::Value nullName;
+        for (auto it = json.Begin(); it != json.End(); ++it)
+        {
+            if (it->IsObject() || it->IsArray())
+            {
+                map_replace_internal(*it, allocator, fn);
+            }
+            else
+            {
+                fn(nullName, *it, allocator);
+            }
+        }
+    }
+    else
+    {
+        rapidjson::Value nullName;
+        fn(nullName, json, allocator);
+    }
+}
+
+} /* impl */
+
+/** map a json dom with any callable map function
+ * @details The same as above, but the map function is template parameter
+ * that can be inlined, see also template `json_filter()`.
+ * */
+template <typename Fn>
+void map_replace(rapidjson::Value& json, rapidjson::Document::AllocatorType& allocator, Fn fn)
+{
+    impl::map_replace_internal(json, allocator, fn);
+}
+
 /** map each leaf node to string type
  * @details Change number/bool/null to string representation. */
 void map_to_string(rapidjson::Value& json, rapidjson::Document::AllocatorType& allocator);
@@ -110,5 +275,148 @@ void map_to_string(rapidjson::Value& json, rapidjson::Document::AllocatorType& a
  * */
 void map_decode_json(rapidjson::Value& json, rapidjson::Document::AllocatorType& allocator);
 
+/** check if a string is valid json object {} or array [], without DOM.
+ * @details Only tokenize the text, use small stack buffer for the parser,
+ * so not allocate memory for most short input.
+ * */
+bool is_json_text(const char* str, size_t len);
+
+/** per-document memo to decode nested json strings lazily.
+ * @details Unlike `map_decode_json()` which decodes each encoded json
+ * string at once into the shared allocator, this leaves the json tree
+ * untouched. A string that looks like {} or [] is decoded on its first
+ * access through the path operator of this memo, into a document owned by
+ * the memo, and later access returns the same decoded value. A string never
+ * accessed is never parsed, and invalid json text is parsed only once and
+ * then remembered to be left as string.
+ * @note The json tree is only read, and should outlive the memo. The memo
+ * itself is not thread safe, but many threads can read a shared document
+ * each with its own memo.
+ * @code
+ * jsonkit::CLazyJson lazy(doc);
+ * int value = *(lazy / "encoded" / "key") | 0;
+ * int other = *(lazy / "encoded/array/1") | 0;
+ * @endcode
+ * */
+class CLazyJson
+{
+public:
+    /// a node in the json tree or in a decoded document, with path operator
+    class Node
+    {
+    public:
+        Node(CLazyJson& lazy, const rapidjson::Value& value) : m_lazy(lazy), m_value(&value) {}
+
+        const rapidjson::Value& operator*() const { return *m_value; }
+        const rapidjson::Value* operator->() const { return m_value; }
+
+        /// path may have many keys joined by '/', each decoded if needed
+        Node operator/(const char* path) const { return Node(m_lazy, m_lazy.Path(*m_value, path)); }
+        Node operator/(const std::string& path) const { return *this / path.c_str(); }
+        Node operator/(size_t index) const { return Node(m_lazy, m_lazy.Index(*m_value, index)); }
+        Node operator/(int index) const { return *this / (size_t)index; }
+
+    private:
+        CLazyJson& m_lazy;
+        const rapidjson::Value* m_value;
+    };
+
+    explicit CLazyJson(const rapidjson::Value& root) : m_root(root) {}
+
+    CLazyJson(const CLazyJson&) = delete;
+    CLazyJson& operator=(const CLazyJson&) = delete;
+
+    /** get the decoded value of an encoded json string.
+     * @return the decoded value, or `value` itself if it is not string or
+     * not valid json text.
+     * @note Invalid text is rejected by is_json_text() before any document
+     * is allocated, and remembered as invalid.
+     * */
+    const rapidjson::Value& Decode(const rapidjson::Value& value);
+
+    /// path operator from node, decode the node and each step on the way
+    const rapidjson::Value& Path(const rapidjson::Value& node, const char* path);
+    const rapidjson::Value& Index(const rapidjson::Value& node, size_t index);
+
+    Node operator/(const char* path) { return Node(*this, m_root) / path; }
+    Node operator/(const std::string& path) { return Node(*this, m_root) / path; }
+    Node operator/(size_t index) { return Node(*this, m_root) / index; }
+    Node operator/(int index) { return Node(*this, m_root) / index; }
+
+    /// the number of string parsed, valid or not
+    size_t Size() const { return m_memo.size(); }
+    /// release all decoded documents
+    void Clear() { m_memo.clear(); }
+
+private:
+    const rapidjson::Value& m_root;
+    // null document for string that is not valid json
+    std::unordered_map<const rapidjson::Value*, std::unique_ptr<rapidjson::Document>> m_memo;
+};
+
+/* ************************************************************ */
+// Section: pipeline
+
+/** compose filter and map stages, and run them in a single traversal.
+ * @details Calling `filter_null()`, `filter_key()`, `map_to_string()` ...
+ * one after another walks the whole json tree again for each one. The
+ * pipeline visits each node only once instead, applying the stages in the
+ * order they are added:
+ * - filter stage is called on every node (as `json_filter()` does), a
+ *   container node that is filtered out is removed without descending it;
+ * - map stage is only called on leaf node (as `map_replace()` does).
+ * Children of a container are processed before the container itself is
+ * checked for empty, so if `RemoveEmpty()` is enabled, the empty array or
+ * object left behind by removing its children is removed in the same pass.
+ * @note A container created by a map stage, eg. `MapDecodeJson()`, is not
+ * descended again, the later stages only see that node itself.
+ * @code
+ * jsonkit::CJsonPipeline pipe;
+ * pipe.FilterNull().FilterKey(keys).MapToString().RemoveEmpty();
+ * int removed = pipe.Run(doc, doc.GetAllocator());
+ * @endcode
+ * */
+class CJsonPipeline
+{
+public:
+    /** add custom filter or map stage */
+    CJsonPipeline& Filter(json_filter_fn fn);
+    CJsonPipeline& Map(json_map_fn fn);
+
+    /** add pre-defined stage, the same as the corresponding free function */
+    CJsonPipeline& FilterNull();
+    CJsonPipeline& FilterEmpty();
+    CJsonPipeline& FilterKey(const std::vector<std::string>& keys, bool keep = true);
+    CJsonPipeline& FilterKey(const std::string& pattern, bool keep = true);
+    CJsonPipeline& MapToString();
+    CJsonPipeline& MapDecodeJson();
+
+    /** also remove empty array or object after its children processed */
+    CJsonPipeline& RemoveEmpty(bool enable = true)
+    {
+        m_removeEmpty = enable;
+        return *this;
+    }
+
+    /** run all stages on json tree
+     * @return the number of removed json node.
+     * */
+    int Run(rapidjson::Value& json, rapidjson::Document::AllocatorType& allocator) const;
+
+private:
+    // return true if the node should be kept
+    bool DoFilter(rapidjson::Value& name, rapidjson::Value& value, rapidjson::Document::AllocatorType& allocator) const;
+    int DoRun(rapidjson::Value& json, rapidjson::Document::AllocatorType& allocator) const;
+
+    // one stage is either filter or map, the other one is empty
+    struct Stage
+    {
+        json_filter_fn filter;
+        json_map_fn map;
+    };
+    std::vector<Stage> m_stages;
+    bool m_removeEmpty = false;
+};
+
 } /* jsonkit */ 
 #endif /* end of include guard: JSON_FILTER_H__ */
@@ -11,6 +11,9 @@
 
 #include "rapidjson/prettywriter.h"
 #include "rapidjson/ostreamwrapper.h"
+#include "rapidjson/internal/itoa.h"
+#include "rapidjson/internal/dtoa.h"
+#include "rapidjson/internal/ieee754.h"
 
 // print json in pretty or condensed format
 namespace jsonkit
@@ -63,4 +66,36 @@ bool condense(const rapidjson::Value& inJson, std::string& outJson)
     return true;
 }
 
+size_t format_number(const rapidjson::Value& json, char* buffer)
+{
+    char* end = buffer;
+    // the same order as rapidjson::Value::Accept()
+    if (json.IsDouble())
+    {
+        double d = json.GetDouble();
+        if (rapidjson::internal::Double(d).IsNanOrInf())
+        {
+            return 0;
+        }
+        end = rapidjson::internal::dtoa(d, buffer);
+    }
+    else if (json.IsInt())
+    {
+        end = rapidjson::internal::i32toa(json.GetInt(), buffer);
+    }
+    else if (json.IsUint())
+    {
+        end = rapidjson::internal::u32toa(json.GetUint(), buffer);
+    }
+    else if (json.IsInt64())
+    {
+        end = rapidjson::internal::i64toa(json.GetInt64(), buffer);
+    }
+    else if (json.IsUint64())
+    {
+        end = rapidjson::internal::u64toa(json.GetUint64(), buffer);
+    }
+    return end - buffer;
+}
+
 } /* jsonkit */ 
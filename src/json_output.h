@@ -33,6 +33,16 @@ std::string stringfy(const rapidjson::Value& json)
     return dest;
 }
 
+/** write number json value into buffer, the same format as stringfy.
+ * @param json: a number json value
+ * @param buffer: output buffer, should have at least 32 bytes
+ * @return the length written, not null terminated, 0 if not number or is
+ * NaN or Inf that not allowed in json.
+ * @details Use the fast itoa/dtoa in rapidjson directly, no stream or
+ * writer object is created.
+ * */
+size_t format_number(const rapidjson::Value& json, char* buffer);
+
 /// to_string much like stringfy but no extra "" for string type
 inline
 std::string to_string(const rapidjson::Value& json)
@@ -4,7 +4,17 @@
  * @date 2021-10-27
  * @brief implementation for json scheam tools
  * */
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <istream>
+#include <ostream>
+#include <string.h>
+#include <unordered_map>
+#include <memory>
 #include <regex>
+#include <thread>
+#include <vector>
 
 #include "json_schema.h"
 #include "json_input.h"
@@ -14,6 +24,11 @@
 #include "json_operator.h"
 
 #include "rapidjson/schema.h"
+#include "rapidjson/reader.h"
+#include "rapidjson/memorystream.h"
+#include "rapidjson/error/en.h"
+#include "rapidjson/stringbuffer.h"
+#include "rapidjson/writer.h"
 
 namespace jsonkit
 {
@@ -263,6 +278,107 @@ bool validate_schema(const rapidjson::Value& inJson, const rapidjson::Value& inS
     return schema.Validate(inJson);
 }
 
+bool validate_schema_text(const char* json, size_t len, const rapidjson::Value& inSchema, const std::string& basedir)
+{
+    std::unique_ptr<CJsonSchema> schema;
+    if (basedir.empty())
+    {
+        schema.reset(new CJsonSchema(inSchema));
+    }
+    else
+    {
+        schema.reset(new CJsonSchema(inSchema, basedir));
+    }
+
+    std::string strError;
+    bool bRet = schema->ValidateText(json, len, strError);
+    if (!strError.empty())
+    {
+        LOGS(strError);
+    }
+    return bRet;
+}
+
+// number of items a worker takes each time in validate_array()
+static const size_t SCHEMA_PARALLEL_CHUNK = 64;
+
+bool validate_array(const rapidjson::Value& array, const schema_item_fn& fn,
+        std::vector<schema_item_error_t>& errors, int threads, bool stopEarly)
+{
+    if (!array.IsArray())
+    {
+        LOGF("validate_array: json is not array");
+        return false;
+    }
+
+    size_t total = array.Size();
+    if (threads <= 0)
+    {
+        threads = std::thread::hardware_concurrency();
+    }
+    size_t workers = (total + SCHEMA_PARALLEL_CHUNK - 1) / SCHEMA_PARALLEL_CHUNK;
+    if (workers > static_cast<size_t>(threads))
+    {
+        workers = threads;
+    }
+    if (workers == 0)
+    {
+        workers = 1;
+    }
+
+    std::atomic<size_t> next(0);
+    std::atomic<bool> stop(false);
+    std::vector<std::vector<schema_item_error_t>> output(workers);
+    auto work = [&](size_t idx) {
+        std::string error;
+        while (!stop.load(std::memory_order_relaxed))
+        {
+            size_t begin = next.fetch_add(SCHEMA_PARALLEL_CHUNK);
+            if (begin >= total)
+            {
+                break;
+            }
+            size_t end = std::min(begin + SCHEMA_PARALLEL_CHUNK, total);
+            for (size_t i = begin; i < end; ++i)
+            {
+                error.clear();
+                if (!fn(array[i], error))
+                {
+                    output[idx].push_back(schema_item_error_t{i, error});
+                    if (stopEarly)
+                    {
+                        stop = true;
+                        break;
+                    }
+                }
+            }
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (size_t i = 1; i < workers; ++i)
+    {
+        pool.emplace_back(work, i);
+    }
+    work(0);
+    for (auto& th : pool)
+    {
+        th.join();
+    }
+
+    size_t found = errors.size();
+    for (auto& part : output)
+    {
+        for (auto& item : part)
+        {
+            errors.push_back(std::move(item));
+        }
+    }
+    std::sort(errors.begin() + found, errors.end(),
+            [](const schema_item_error_t& a, const schema_item_error_t& b) { return a.index < b.index; });
+    return errors.size() == found;
+}
+
 } /* jsonkit */ 
 
 /* ************************************************************ */
@@ -300,11 +416,6 @@ private:
     bool checkArrayOf(const rapidjson::Value& schema, const rapidjson::Value& value, checkPMF pmf);
     bool checkArrayOr(const rapidjson::Value& schema, const rapidjson::Value& value, checkPMF pmf);
 
-    void DefaultError(std::string& str) const
-    {
-        str.append("INVALID ").append(m_path).append(" AGAINST ");
-        str.append(m_skey).append(": ").append(m_sval);
-    }
     void SimpleError(std::string& str) const
     {
         str.append(m_error).append(" ").append(m_path);
@@ -346,28 +457,27 @@ private:
     std::string m_error;
 };
 
-void CFlatSchema::GetError(std::string& out) const
+// format error message for flat schema, shared by CFlatSchema and
+// CFlatSchemaCompiled, replace {var} in template `format[skey]`.
+static
+void format_flat_error(std::string& out, const rapidjson::Value* format, const rapidjson::Value* sitem,
+        const std::string& path, const std::string& skey, const std::string& sval)
 {
-    if (!m_error.empty())
-    {
-        return SimpleError(out);
-    }
-
-    if (!m_format || !m_sitem)
+    const char* pszTemp = nullptr;
+    if (format && sitem)
     {
-        return DefaultError(out);
+        // error format template
+        // {/name} on {path} is invalid, please check {skey} = {sval}
+        pszTemp |= *(format) / skey;
     }
 
-    // error format template
-    // {/name} on {path} is invalid, please check {skey} = {sval}
-    const char* pszTemp = nullptr;
-    pszTemp |= *(m_format) / m_skey;
-
     if (!pszTemp)
     {
-        return DefaultError(out);
+        out.append("INVALID ").append(path).append(" AGAINST ");
+        out.append(skey).append(": ").append(sval);
+        return;
     }
-    
+
     const char* pLeft = nullptr;
     for (const char* pHead = pszTemp; *pHead != '\0'; ++pHead)
     {
@@ -391,7 +501,7 @@ void CFlatSchema::GetError(std::string& out) const
             std::string var(pLeft, pHead);
             if(var[0] == '/')
             {
-                auto& jp = (*m_sitem)/var;
+                auto& jp = (*sitem)/var;
                 if (!!jp)
                 {
                     out.append(to_string(jp));
@@ -399,15 +509,15 @@ void CFlatSchema::GetError(std::string& out) const
             }
             else if (var == "path")
             {
-                out.append(m_path);
+                out.append(path);
             }
             else if (var == "skey")
             {
-                out.append(m_skey);
+                out.append(skey);
             }
             else if (var == "sval")
             {
-                out.append(m_sval);
+                out.append(sval);
             }
 
             pLeft = nullptr;
@@ -415,6 +525,16 @@ void CFlatSchema::GetError(std::string& out) const
     }
 }
 
+void CFlatSchema::GetError(std::string& out) const
+{
+    if (!m_error.empty())
+    {
+        return SimpleError(out);
+    }
+
+    format_flat_error(out, m_format, m_sitem, m_path, m_skey, m_sval);
+}
+
 bool CFlatSchema::checkString(const rapidjson::Value& schema, const rapidjson::Value& value)
 {
     if (!value.IsString())
@@ -484,12 +604,12 @@ bool CFlatSchema::checkNumber(const rapidjson::Value& schema, const rapidjson::V
     if (value.IsDouble())
     {
         double max = 0;
-        if (scalar_value(max, schema/"maxValue") && value.GetInt64() > max)
+        if (scalar_value(max, schema/"maxValue") && value.GetDouble() > max)
         {
             return FalseError(schema, "maxValue", std::to_string(max));
         }
         double min = 0;
-        if (scalar_value(min, schema/"minValue") && value.GetInt64() < min)
+        if (scalar_value(min, schema/"minValue") && value.GetDouble() < min)
         {
             return FalseError(schema, "minValue", std::to_string(min));
         }
@@ -685,4 +805,1804 @@ bool validate_flat_schema(const rapidjson::Value& json, const rapidjson::Value&
     return ret;
 }
 
-} /* jsonkit */ 
+/* ************************************************************ */
+// compiled flat schema
+
+namespace impl
+{
+
+enum flat_type_t : uint8_t
+{
+    FLAT_TYPE_NONE = 0, // unknown type, not check
+    FLAT_TYPE_STRING,
+    FLAT_TYPE_NUMBER,
+    FLAT_TYPE_BOOL,
+    FLAT_TYPE_OBJECT,
+};
+
+enum flat_shape_t : uint8_t
+{
+    FLAT_SHAPE_SCALAR = 0, // single value of type
+    FLAT_SHAPE_ARRAY_OR,   // "type or array"
+    FLAT_SHAPE_ARRAY_OF,   // "array of type"
+};
+
+// one schema item, with key and bounds read out from schema json.
+struct flat_node_t
+{
+    const rapidjson::Value* item = nullptr; // original item in flat_tree_t
+    std::string name;
+    bool required = false;
+    bool slash = false;      // name contains '/', may be a json path
+    flat_type_t type = FLAT_TYPE_NONE;
+    flat_shape_t shape = FLAT_SHAPE_SCALAR;
+
+    size_t minLength = 0;
+    size_t maxLength = 0;
+    const char* patternText = nullptr;
+    std::shared_ptr<std::regex> pattern;
+
+    bool hasMinInt = false;
+    bool hasMaxInt = false;
+    bool hasMinDouble = false;
+    bool hasMaxDouble = false;
+    int64_t minInt = 0;
+    int64_t maxInt = 0;
+    double minDouble = 0;
+    double maxDouble = 0;
+
+    // children nodes for object, in range [childBeg, childEnd)
+    uint32_t childBeg = 0;
+    uint32_t childEnd = 0;
+    // key trie and required bits of children, for streaming validation
+    uint32_t childTrie = 0;
+    uint32_t childBits = 0;
+};
+
+// one state of key name trie, the edges are few so scan linearly.
+struct flat_trie_t
+{
+    std::vector<std::pair<char, uint32_t>> edges;
+    int32_t leaf = -1; // index of node whose name ends here
+};
+
+// all nodes of one flat schema, nodes of the same level are continuous.
+struct flat_tree_t
+{
+    rapidjson::Document schema;
+    rapidjson::Document format;
+    bool hasFormat = false;
+    std::vector<flat_node_t> nodes;
+    uint32_t rootEnd = 0; // top level nodes in [0, rootEnd)
+
+    // each level has its own trie root in `tries`, and required bitset in
+    // `requiredBits` as (end - beg + 63) / 64 words from its offset.
+    std::vector<flat_trie_t> tries;
+    std::vector<uint64_t> requiredBits;
+    uint32_t rootTrie = 0;
+    uint32_t rootBits = 0;
+    // some name is json path, that cannot match key by key when streaming
+    bool hasSlash = false;
+};
+
+static inline
+uint32_t flat_words(uint32_t beg, uint32_t end)
+{
+    return (end - beg + 63) / 64;
+}
+
+// context of one validation call.
+// The path is tracked as a stack of node or array index, and rendered to
+// string only when an error is reported.
+struct flat_context_t
+{
+    struct step_t
+    {
+        const flat_node_t* node; // object key, or null for array index
+        size_t index;
+    };
+
+    const rapidjson::Value* format = nullptr;
+    // null in boolean mode, then no path nor error message at all
+    std::vector<std::string>* errors = nullptr;
+    // stop after so many errors, 0 for no limit
+    size_t maxErrors = 1;
+    size_t failed = 0;
+    std::vector<step_t> path;
+
+    bool Report() const { return errors != nullptr; }
+    bool Stop() const { return maxErrors > 0 && failed >= maxErrors; }
+
+    void Push(const flat_node_t* node, size_t index)
+    {
+        if (errors != nullptr)
+        {
+            path.push_back(step_t{node, index});
+        }
+    }
+    void Pop()
+    {
+        if (errors != nullptr)
+        {
+            path.pop_back();
+        }
+    }
+};
+
+static
+void compile_flat_type(flat_node_t& node, const std::string& type)
+{
+    static const struct { const char* name; flat_type_t type; flat_shape_t shape; } s_types[] = {
+        { "string", FLAT_TYPE_STRING, FLAT_SHAPE_SCALAR },
+        { "number", FLAT_TYPE_NUMBER, FLAT_SHAPE_SCALAR },
+        { "bool", FLAT_TYPE_BOOL, FLAT_SHAPE_SCALAR },
+        { "boolean", FLAT_TYPE_BOOL, FLAT_SHAPE_SCALAR },
+        { "object", FLAT_TYPE_OBJECT, FLAT_SHAPE_SCALAR },
+        { "string or array", FLAT_TYPE_STRING, FLAT_SHAPE_ARRAY_OR },
+        { "number or array", FLAT_TYPE_NUMBER, FLAT_SHAPE_ARRAY_OR },
+        { "object or array", FLAT_TYPE_OBJECT, FLAT_SHAPE_ARRAY_OR },
+        { "array", FLAT_TYPE_OBJECT, FLAT_SHAPE_ARRAY_OF },
+        { "array of object", FLAT_TYPE_OBJECT, FLAT_SHAPE_ARRAY_OF },
+        { "array of number", FLAT_TYPE_NUMBER, FLAT_SHAPE_ARRAY_OF },
+        { "array of string", FLAT_TYPE_STRING, FLAT_SHAPE_ARRAY_OF },
+    };
+
+    for (auto& entry : s_types)
+    {
+        if (type == entry.name)
+        {
+            node.type = entry.type;
+            node.shape = entry.shape;
+            return;
+        }
+    }
+}
+
+static
+void compile_flat_node(flat_node_t& node, const rapidjson::Value& item)
+{
+    node.item = &item;
+    node.name = item/"name" | "";
+    node.required = item/"required" | false;
+    node.slash = node.name.find('/') != std::string::npos;
+    compile_flat_type(node, item/"type" | "");
+
+    if (node.type == FLAT_TYPE_STRING)
+    {
+        node.maxLength = item/"maxLength" | 0;
+        node.minLength = item/"minLength" | 0;
+        auto& pattern = item/"pattern";
+        if (!!pattern && pattern.IsString() && pattern.GetStringLength() > 0)
+        {
+            try
+            {
+                node.pattern = std::make_shared<std::regex>(pattern.GetString());
+                node.patternText = pattern.GetString();
+            }
+            catch (const std::regex_error&)
+            {
+                // only log, not check, the same as CFlatSchema
+                LOGF("PATTERN INVALID: %s", pattern.GetString());
+            }
+        }
+    }
+    else if (node.type == FLAT_TYPE_NUMBER)
+    {
+        node.hasMaxInt = scalar_value(node.maxInt, item/"maxValue");
+        node.hasMinInt = scalar_value(node.minInt, item/"minValue");
+        node.hasMaxDouble = scalar_value(node.maxDouble, item/"maxValue");
+        node.hasMinDouble = scalar_value(node.minDouble, item/"minValue");
+    }
+}
+
+// build key trie and required bitset for nodes in [beg, end).
+static
+void compile_flat_keys(flat_tree_t& tree, uint32_t beg, uint32_t end, uint32_t& trie, uint32_t& bits)
+{
+    trie = tree.tries.size();
+    tree.tries.emplace_back();
+    bits = tree.requiredBits.size();
+    tree.requiredBits.resize(bits + flat_words(beg, end), 0);
+
+    for (uint32_t i = beg; i < end; ++i)
+    {
+        const flat_node_t& node = tree.nodes[i];
+        tree.hasSlash = tree.hasSlash || node.slash;
+
+        uint32_t state = trie;
+        for (char c : node.name)
+        {
+            uint32_t next = 0;
+            for (auto& edge : tree.tries[state].edges)
+            {
+                if (edge.first == c)
+                {
+                    next = edge.second;
+                    break;
+                }
+            }
+            if (next == 0)
+            {
+                next = tree.tries.size();
+                tree.tries[state].edges.emplace_back(c, next);
+                tree.tries.emplace_back();
+            }
+            state = next;
+        }
+        // the first one wins for duplicated name
+        if (tree.tries[state].leaf < 0)
+        {
+            tree.tries[state].leaf = i;
+        }
+        // only the leaf is marked seen by key, so required of duplicated
+        // name goes to the leaf bit
+        if (node.required)
+        {
+            uint32_t leaf = tree.tries[state].leaf;
+            tree.requiredBits[bits + (leaf - beg) / 64] |= uint64_t(1) << ((leaf - beg) % 64);
+        }
+    }
+}
+
+// compile one level of schema array, then the children of each node.
+static
+void compile_flat_level(flat_tree_t& tree, const rapidjson::Value& schema, uint32_t& beg, uint32_t& end,
+        uint32_t& trie, uint32_t& bits)
+{
+    beg = end = tree.nodes.size();
+    for (auto it = schema.Begin(); it != schema.End(); ++it)
+    {
+        const char* name = it->IsObject() ? (*it/"name" | "") : "";
+        if (name[0] == '\0')
+        {
+            continue;
+        }
+        tree.nodes.emplace_back();
+        compile_flat_node(tree.nodes.back(), *it);
+    }
+    end = tree.nodes.size();
+    compile_flat_keys(tree, beg, end, trie, bits);
+
+    for (uint32_t i = beg; i < end; ++i)
+    {
+        // tree.nodes may reallocate in recursion, not hold reference
+        const rapidjson::Value& children = *tree.nodes[i].item/"children";
+        if (tree.nodes[i].type == FLAT_TYPE_OBJECT && !!children && children.IsArray())
+        {
+            uint32_t childBeg = 0;
+            uint32_t childEnd = 0;
+            uint32_t childTrie = 0;
+            uint32_t childBits = 0;
+            compile_flat_level(tree, children, childBeg, childEnd, childTrie, childBits);
+            tree.nodes[i].childBeg = childBeg;
+            tree.nodes[i].childEnd = childEnd;
+            tree.nodes[i].childTrie = childTrie;
+            tree.nodes[i].childBits = childBits;
+        }
+        else if (tree.nodes[i].type == FLAT_TYPE_OBJECT)
+        {
+            // empty level, any key is unknown
+            uint32_t childBeg = tree.nodes.size();
+            compile_flat_keys(tree, childBeg, childBeg, tree.nodes[i].childTrie, tree.nodes[i].childBits);
+            tree.nodes[i].childBeg = tree.nodes[i].childEnd = childBeg;
+        }
+    }
+}
+
+static
+bool flat_false(flat_context_t& ctx, const flat_node_t* node, const char* skey, const std::string& sval)
+{
+    ctx.failed++;
+    if (!ctx.Report())
+    {
+        return false;
+    }
+
+    std::string path;
+    for (auto& step : ctx.path)
+    {
+        path.append("/");
+        if (step.node != nullptr)
+        {
+            path.append(step.node->name);
+        }
+        else
+        {
+            path.append(std::to_string(step.index));
+        }
+    }
+
+    ctx.errors->emplace_back();
+    const rapidjson::Value* sitem = node != nullptr ? node->item : nullptr;
+    format_flat_error(ctx.errors->back(), ctx.format, sitem, path, skey, sval);
+    return false;
+}
+
+// only convert the bound to string when report error
+template <typename T>
+bool flat_false_bound(flat_context_t& ctx, const flat_node_t& node, const char* skey, T bound)
+{
+    return flat_false(ctx, &node, skey, ctx.Report() ? std::to_string(bound) : std::string());
+}
+
+// forword declare
+bool validate_flat_level(const flat_tree_t& tree, uint32_t beg, uint32_t end,
+        const rapidjson::Value& json, flat_context_t& ctx);
+
+static
+bool validate_flat_string(const flat_node_t& node, const rapidjson::Value& value, flat_context_t& ctx)
+{
+    if (!value.IsString())
+    {
+        return flat_false(ctx, &node, "type", "string");
+    }
+
+    size_t length = value.GetStringLength();
+    if (node.maxLength > 0 && length > node.maxLength)
+    {
+        return flat_false_bound(ctx, node, "maxLength", node.maxLength);
+    }
+    if (node.minLength > 0 && length < node.minLength)
+    {
+        return flat_false_bound(ctx, node, "minLength", node.minLength);
+    }
+
+    if (node.pattern && !std::regex_match(value.GetString(), value.GetString() + length, *node.pattern))
+    {
+        return flat_false(ctx, &node, "pattern", node.patternText);
+    }
+
+    return true;
+}
+
+static
+bool validate_flat_number(const flat_node_t& node, const rapidjson::Value& value, flat_context_t& ctx)
+{
+    if (!value.IsNumber())
+    {
+        return flat_false(ctx, &node, "type", "number");
+    }
+
+    if (value.IsInt64())
+    {
+        int64_t num = value.GetInt64();
+        if (node.hasMaxInt && num > node.maxInt)
+        {
+            return flat_false_bound(ctx, node, "maxValue", node.maxInt);
+        }
+        if (node.hasMinInt && num < node.minInt)
+        {
+            return flat_false_bound(ctx, node, "minValue", node.minInt);
+        }
+    }
+    if (value.IsDouble())
+    {
+        double num = value.GetDouble();
+        if (node.hasMaxDouble && num > node.maxDouble)
+        {
+            return flat_false_bound(ctx, node, "maxValue", node.maxDouble);
+        }
+        if (node.hasMinDouble && num < node.minDouble)
+        {
+            return flat_false_bound(ctx, node, "minValue", node.minDouble);
+        }
+    }
+    return true;
+}
+
+static
+bool validate_flat_scalar(const flat_tree_t& tree, const flat_node_t& node,
+        const rapidjson::Value& value, flat_context_t& ctx)
+{
+    switch (node.type)
+    {
+    case FLAT_TYPE_STRING:
+        return validate_flat_string(node, value, ctx);
+    case FLAT_TYPE_NUMBER:
+        return validate_flat_number(node, value, ctx);
+    case FLAT_TYPE_BOOL:
+        if (!value.IsBool())
+        {
+            return flat_false(ctx, &node, "type", "bool");
+        }
+        return true;
+    case FLAT_TYPE_OBJECT:
+        if (!value.IsObject())
+        {
+            return flat_false(ctx, &node, "type", "object");
+        }
+        return validate_flat_level(tree, node.childBeg, node.childEnd, value, ctx);
+    default:
+        return true;
+    }
+}
+
+static
+bool validate_flat_array(const flat_tree_t& tree, const flat_node_t& node,
+        const rapidjson::Value& value, flat_context_t& ctx)
+{
+    if (!value.IsArray())
+    {
+        return flat_false(ctx, &node, "type", "array");
+    }
+
+    bool pass = true;
+    for (rapidjson::SizeType i = 0; i < value.Size(); ++i)
+    {
+        ctx.Push(nullptr, i);
+        bool ok = validate_flat_scalar(tree, node, value[i], ctx);
+        ctx.Pop();
+        if (!ok)
+        {
+            pass = false;
+            if (ctx.Stop())
+            {
+                return false;
+            }
+        }
+    }
+
+    return pass;
+}
+
+bool validate_flat_level(const flat_tree_t& tree, uint32_t beg, uint32_t end,
+        const rapidjson::Value& json, flat_context_t& ctx)
+{
+    if (!json.IsObject())
+    {
+        return flat_false(ctx, nullptr, "type", "object");
+    }
+
+    bool pass = true;
+    for (uint32_t i = beg; i < end; ++i)
+    {
+        const flat_node_t& node = tree.nodes[i];
+
+        const rapidjson::Value* value = nullptr;
+        auto it = json.FindMember(rapidjson::StringRef(node.name.c_str(), node.name.size()));
+        if (it != json.MemberEnd())
+        {
+            value = &(it->value);
+        }
+        else if (node.slash)
+        {
+            auto& jp = json/node.name;
+            value = !jp ? nullptr : &jp;
+        }
+
+        bool ok = true;
+        ctx.Push(&node, 0);
+        if (value == nullptr || value->IsNull())
+        {
+            if (node.required)
+            {
+                ok = flat_false(ctx, &node, "required", "true");
+            }
+        }
+        else if (node.shape == FLAT_SHAPE_ARRAY_OF || (node.shape == FLAT_SHAPE_ARRAY_OR && value->IsArray()))
+        {
+            ok = validate_flat_array(tree, node, *value, ctx);
+        }
+        else
+        {
+            ok = validate_flat_scalar(tree, node, *value, ctx);
+        }
+        ctx.Pop();
+
+        if (!ok)
+        {
+            pass = false;
+            if (ctx.Stop())
+            {
+                return false;
+            }
+        }
+    }
+
+    return pass;
+}
+
+// type name in error message, the same as validate_flat_scalar()
+static
+const char* flat_type_name(flat_type_t type)
+{
+    switch (type)
+    {
+    case FLAT_TYPE_STRING:
+        return "string";
+    case FLAT_TYPE_NUMBER:
+        return "number";
+    case FLAT_TYPE_BOOL:
+        return "bool";
+    case FLAT_TYPE_OBJECT:
+        return "object";
+    default:
+        return "";
+    }
+}
+
+static
+int32_t flat_trie_find(const flat_tree_t& tree, uint32_t trie, const char* key, size_t len)
+{
+    uint32_t state = trie;
+    for (size_t i = 0; i < len; ++i)
+    {
+        uint32_t next = 0;
+        for (auto& edge : tree.tries[state].edges)
+        {
+            if (edge.first == key[i])
+            {
+                next = edge.second;
+                break;
+            }
+        }
+        if (next == 0)
+        {
+            return -1;
+        }
+        state = next;
+    }
+    return tree.tries[state].leaf;
+}
+
+/** SAX handler that validate json text against compiled flat schema.
+ * @details Each open object has a frame with the trie of its level and a
+ * range of words in `m_seen` for present keys, so a key is matched while
+ * tokenized and the missing required keys are found at the end of object
+ * by masking the required bitset. Scalar value is wrapped in a temporary
+ * Value without copy, and checked by the same function as DOM validation.
+ * Value of unknown key, or of node without type, is skipped.
+ * */
+class CFlatStreamHandler : public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, CFlatStreamHandler>
+{
+public:
+    CFlatStreamHandler(const flat_tree_t& tree, flat_context_t& ctx)
+        : m_tree(tree), m_ctx(ctx) {}
+
+    bool Null() { return Scalar(rapidjson::Value(), true); }
+    bool Bool(bool b) { return Scalar(rapidjson::Value(b)); }
+    bool Int(int i) { return Scalar(rapidjson::Value(i)); }
+    bool Uint(unsigned u) { return Scalar(rapidjson::Value(u)); }
+    bool Int64(int64_t i) { return Scalar(rapidjson::Value(i)); }
+    bool Uint64(uint64_t u) { return Scalar(rapidjson::Value(u)); }
+    bool Double(double d) { return Scalar(rapidjson::Value(d)); }
+    bool String(const char* str, rapidjson::SizeType len, bool copy)
+    {
+        return Scalar(rapidjson::Value(rapidjson::StringRef(str, len)));
+    }
+    bool StartObject();
+    bool Key(const char* str, rapidjson::SizeType len, bool copy);
+    bool EndObject(rapidjson::SizeType memberCount);
+    bool StartArray();
+    bool EndArray(rapidjson::SizeType elementCount);
+
+private:
+    // open object or array that is validating
+    struct frame_t
+    {
+        const flat_node_t* node; // null for root object
+        bool array;
+        int32_t key;    // object: current key node, -1 for unknown
+        size_t index;   // array: next index
+        size_t seen;    // object: offset of present bits in m_seen
+    };
+
+    // find the node for the next value, return false to skip it
+    bool Next(const flat_node_t*& node, bool& element);
+    bool Scalar(const rapidjson::Value& value, bool null = false);
+    // push frame for object or array value, return false to skip it
+    bool Open(bool array);
+    bool Close();
+    bool Fail(const flat_node_t* node, const char* skey, const std::string& sval);
+
+    const flat_tree_t& m_tree;
+    flat_context_t& m_ctx;
+    std::vector<frame_t> m_stack;
+    std::vector<uint64_t> m_seen;
+    // depth of container skipped
+    int m_skip = 0;
+};
+
+bool CFlatStreamHandler::Next(const flat_node_t*& node, bool& element)
+{
+    node = nullptr;
+    element = false;
+    if (m_stack.empty())
+    {
+        return true;
+    }
+
+    frame_t& top = m_stack.back();
+    if (top.array)
+    {
+        node = top.node;
+        element = true;
+        m_ctx.Push(nullptr, top.index++);
+        return true;
+    }
+
+    if (top.key < 0)
+    {
+        return false;
+    }
+    node = &m_tree.nodes[top.key];
+    m_ctx.Push(node, 0);
+    return true;
+}
+
+// flat_false() and stop the parser if no more error wanted
+bool CFlatStreamHandler::Fail(const flat_node_t* node, const char* skey, const std::string& sval)
+{
+    flat_false(m_ctx, node, skey, sval);
+    return !m_ctx.Stop();
+}
+
+bool CFlatStreamHandler::Scalar(const rapidjson::Value& value, bool null)
+{
+    if (m_skip > 0)
+    {
+        return true;
+    }
+    const flat_node_t* node = nullptr;
+    bool element = false;
+    if (!Next(node, element))
+    {
+        return true;
+    }
+
+    bool ok = true;
+    if (node == nullptr)
+    {
+        ok = Fail(nullptr, "type", "object");
+    }
+    else if (null && !element)
+    {
+        // null key is the same as not present
+        frame_t& top = m_stack.back();
+        uint32_t offset = top.key - (top.node ? top.node->childBeg : 0);
+        m_seen[top.seen + offset / 64] &= ~(uint64_t(1) << (offset % 64));
+    }
+    else if (!element && node->shape == FLAT_SHAPE_ARRAY_OF)
+    {
+        ok = Fail(node, "type", "array");
+    }
+    else if (!validate_flat_scalar(m_tree, *node, value, m_ctx))
+    {
+        ok = !m_ctx.Stop();
+    }
+    if (node != nullptr)
+    {
+        m_ctx.Pop();
+    }
+    return ok;
+}
+
+bool CFlatStreamHandler::Open(bool array)
+{
+    if (m_skip > 0)
+    {
+        m_skip++;
+        return true;
+    }
+    const flat_node_t* node = nullptr;
+    bool element = false;
+    if (!Next(node, element))
+    {
+        m_skip = 1;
+        return true;
+    }
+
+    // the expected type if the container is invalid
+    const char* expect = nullptr;
+    bool open = false;
+    if (node == nullptr)
+    {
+        open = !array;
+        expect = array ? "object" : nullptr;
+    }
+    else if (array && !element && node->shape != FLAT_SHAPE_SCALAR)
+    {
+        open = true;
+    }
+    else if (!array && !element && node->shape == FLAT_SHAPE_ARRAY_OF)
+    {
+        expect = "array";
+    }
+    else if (!array && node->type == FLAT_TYPE_OBJECT)
+    {
+        open = true;
+    }
+    else if (node->type != FLAT_TYPE_NONE)
+    {
+        expect = flat_type_name(node->type);
+    }
+
+    if (!open)
+    {
+        // skip container without type, or invalid one in collect mode
+        m_skip = 1;
+        bool ok = expect == nullptr || Fail(node, "type", expect);
+        if (node != nullptr)
+        {
+            m_ctx.Pop();
+        }
+        return ok;
+    }
+
+    m_stack.push_back(frame_t{node, array, -1, 0, m_seen.size()});
+    if (!array)
+    {
+        uint32_t beg = node ? node->childBeg : 0;
+        uint32_t end = node ? node->childEnd : m_tree.rootEnd;
+        m_seen.resize(m_seen.size() + flat_words(beg, end), 0);
+    }
+    return true;
+}
+
+bool CFlatStreamHandler::Close()
+{
+    if (m_skip > 0)
+    {
+        m_skip--;
+        return true;
+    }
+
+    frame_t top = m_stack.back();
+    m_stack.pop_back();
+    bool ok = true;
+    if (!top.array)
+    {
+        uint32_t beg = top.node ? top.node->childBeg : 0;
+        uint32_t end = top.node ? top.node->childEnd : m_tree.rootEnd;
+        uint32_t bits = top.node ? top.node->childBits : m_tree.rootBits;
+        for (uint32_t w = 0; w < flat_words(beg, end) && ok; ++w)
+        {
+            uint64_t lack = m_tree.requiredBits[bits + w] & ~m_seen[top.seen + w];
+            for (uint32_t b = 0; lack != 0 && ok; ++b, lack >>= 1)
+            {
+                if (lack & 1)
+                {
+                    const flat_node_t& node = m_tree.nodes[beg + w * 64 + b];
+                    m_ctx.Push(&node, 0);
+                    ok = Fail(&node, "required", "true");
+                    m_ctx.Pop();
+                }
+            }
+        }
+        m_seen.resize(top.seen);
+    }
+
+    if (top.node != nullptr)
+    {
+        m_ctx.Pop();
+    }
+    return ok;
+}
+
+bool CFlatStreamHandler::StartObject()
+{
+    return Open(false);
+}
+
+bool CFlatStreamHandler::Key(const char* str, rapidjson::SizeType len, bool copy)
+{
+    if (m_skip > 0)
+    {
+        return true;
+    }
+    frame_t& top = m_stack.back();
+    uint32_t trie = top.node ? top.node->childTrie : m_tree.rootTrie;
+    top.key = flat_trie_find(m_tree, trie, str, len);
+    if (top.key >= 0)
+    {
+        uint32_t offset = top.key - (top.node ? top.node->childBeg : 0);
+        m_seen[top.seen + offset / 64] |= uint64_t(1) << (offset % 64);
+    }
+    return true;
+}
+
+bool CFlatStreamHandler::EndObject(rapidjson::SizeType memberCount)
+{
+    return Close();
+}
+
+bool CFlatStreamHandler::StartArray()
+{
+    return Open(true);
+}
+
+bool CFlatStreamHandler::EndArray(rapidjson::SizeType elementCount)
+{
+    return Close();
+}
+
+// parse and validate json text, append parse error message to `error`
+static
+bool validate_flat_text(const flat_tree_t& tree, const char* json, size_t len,
+        flat_context_t& ctx, std::string* error)
+{
+    rapidjson::ParseResult result;
+    if (tree.hasSlash)
+    {
+        // json path name need the whole DOM to look up
+        rapidjson::Document doc;
+        doc.Parse(json, len);
+        result = doc;
+        if (!doc.HasParseError())
+        {
+            return validate_flat_level(tree, 0, tree.rootEnd, doc, ctx);
+        }
+    }
+    else
+    {
+        CFlatStreamHandler handler(tree, ctx);
+        rapidjson::Reader reader;
+        rapidjson::MemoryStream ms(json, len);
+        result = reader.Parse(ms, handler);
+        if (!result.IsError())
+        {
+            return ctx.failed == 0;
+        }
+        if (ctx.failed > 0)
+        {
+            return false;
+        }
+    }
+
+    if (error != nullptr)
+    {
+        error->append("Parse Json Error(offset ").append(std::to_string(result.Offset())).append("): ");
+        error->append(rapidjson::GetParseError_En(result.Code()));
+    }
+    return false;
+}
+
+} /* impl */
+
+CFlatSchemaCompiled::CFlatSchemaCompiled(const rapidjson::Value& schema, const rapidjson::Value* format)
+{
+    Compile(schema, format);
+}
+
+CFlatSchemaCompiled::~CFlatSchemaCompiled()
+{
+    delete m_tree;
+    m_tree = nullptr;
+}
+
+bool CFlatSchemaCompiled::Compile(const rapidjson::Value& schema, const rapidjson::Value* format)
+{
+    delete m_tree;
+    m_tree = nullptr;
+
+    if (!schema.IsArray())
+    {
+        LOGF("flat schema should be array");
+        return false;
+    }
+
+    impl::flat_tree_t* tree = new impl::flat_tree_t;
+    tree->schema.CopyFrom(schema, tree->schema.GetAllocator());
+    if (format != nullptr)
+    {
+        tree->format.CopyFrom(*format, tree->format.GetAllocator());
+        tree->hasFormat = true;
+    }
+
+    uint32_t beg = 0;
+    impl::compile_flat_level(*tree, tree->schema, beg, tree->rootEnd, tree->rootTrie, tree->rootBits);
+    m_tree = tree;
+    return true;
+}
+
+bool CFlatSchemaCompiled::Validate(const rapidjson::Value& json) const
+{
+    if (m_tree == nullptr)
+    {
+        return false;
+    }
+    impl::flat_context_t ctx;
+    return impl::validate_flat_level(*m_tree, 0, m_tree->rootEnd, json, ctx);
+}
+
+bool CFlatSchemaCompiled::Validate(const rapidjson::Value& json, std::string& error) const
+{
+    if (m_tree == nullptr)
+    {
+        error.append("INVALID FLAT SCHEMA");
+        return false;
+    }
+
+    std::vector<std::string> errors;
+    bool ret = Validate(json, errors, 1);
+    if (!ret && !errors.empty())
+    {
+        error.append(errors[0]);
+    }
+    return ret;
+}
+
+bool CFlatSchemaCompiled::Validate(const rapidjson::Value& json, std::vector<std::string>& errors, size_t maxErrors) const
+{
+    if (m_tree == nullptr)
+    {
+        errors.push_back("INVALID FLAT SCHEMA");
+        return false;
+    }
+
+    impl::flat_context_t ctx;
+    ctx.format = m_tree->hasFormat ? &m_tree->format : nullptr;
+    ctx.errors = &errors;
+    ctx.maxErrors = maxErrors;
+    return impl::validate_flat_level(*m_tree, 0, m_tree->rootEnd, json, ctx);
+}
+
+bool CFlatSchemaCompiled::ValidateText(const char* json, size_t len) const
+{
+    if (m_tree == nullptr)
+    {
+        return false;
+    }
+    impl::flat_context_t ctx;
+    return impl::validate_flat_text(*m_tree, json, len, ctx, nullptr);
+}
+
+bool CFlatSchemaCompiled::ValidateText(const char* json, size_t len, std::string& error) const
+{
+    if (m_tree == nullptr)
+    {
+        error.append("INVALID FLAT SCHEMA");
+        return false;
+    }
+
+    std::vector<std::string> errors;
+    impl::flat_context_t ctx;
+    ctx.format = m_tree->hasFormat ? &m_tree->format : nullptr;
+    ctx.errors = &errors;
+    ctx.maxErrors = 1;
+    bool ret = impl::validate_flat_text(*m_tree, json, len, ctx, &error);
+    if (!ret && !errors.empty())
+    {
+        error.append(errors[0]);
+    }
+    return ret;
+}
+
+bool CFlatSchemaCompiled::ValidateArray(const rapidjson::Value& array, std::vector<schema_item_error_t>& errors,
+        int threads, bool stopEarly) const
+{
+    auto fn = [this](const rapidjson::Value& item, std::string& error) {
+        return Validate(item, error);
+    };
+    return validate_array(array, fn, errors, threads, stopEarly);
+}
+
+} /* jsonkit */ 
+
+/* ************************************************************ */
+// schema accumulator from many samples
+
+namespace jsonkit
+{
+namespace impl
+{
+
+enum schema_type_t
+{
+    SCHEMA_TYPE_NULL = 0,
+    SCHEMA_TYPE_BOOLEAN,
+    SCHEMA_TYPE_INTEGER,
+    SCHEMA_TYPE_NUMBER,
+    SCHEMA_TYPE_STRING,
+    SCHEMA_TYPE_OBJECT,
+    SCHEMA_TYPE_ARRAY,
+    SCHEMA_TYPE_COUNT,
+};
+
+static const char* s_schemaTypeName[SCHEMA_TYPE_COUNT] = {
+    "null", "boolean", "integer", "number", "string", "object", "array",
+};
+
+// observations of one field, or the items of array
+struct schema_node_t
+{
+    size_t count = 0; // times the field occurs
+    size_t typeCount[SCHEMA_TYPE_COUNT] = {0};
+
+    // all numbers as double, and exact integer bounds split at INT64_MAX
+    double minNumber = 0;
+    double maxNumber = 0;
+    bool hasInt64 = false;
+    int64_t minInt64 = 0;
+    int64_t maxInt64 = 0;
+    bool hasUint64 = false;
+    uint64_t minUint64 = 0;
+    uint64_t maxUint64 = 0;
+    size_t minLength = 0;
+    size_t maxLength = 0;
+    size_t minItems = 0;
+    size_t maxItems = 0;
+
+    // distinct string values, cleared and overflow if too many
+    std::vector<std::string> enums;
+    bool enumOverflow = false;
+
+    // object fields in the order first seen
+    std::vector<std::pair<std::string, std::unique_ptr<schema_node_t>>> props;
+    std::unordered_map<std::string, size_t> propIndex;
+
+    // all items of array
+    std::unique_ptr<schema_node_t> items;
+
+    schema_node_t* Field(const std::string& name)
+    {
+        auto it = propIndex.find(name);
+        if (it != propIndex.end())
+        {
+            return props[it->second].second.get();
+        }
+        propIndex[name] = props.size();
+        props.emplace_back(name, std::unique_ptr<schema_node_t>(new schema_node_t));
+        return props.back().second.get();
+    }
+
+    schema_node_t* Items()
+    {
+        if (!items)
+        {
+            items.reset(new schema_node_t);
+        }
+        return items.get();
+    }
+};
+
+// update [minValue, maxValue] with value, init by the first seen
+template <typename T>
+void schema_range(T& minValue, T& maxValue, T value, bool first)
+{
+    if (first || value < minValue)
+    {
+        minValue = value;
+    }
+    if (first || value > maxValue)
+    {
+        maxValue = value;
+    }
+}
+
+// integer range of value, only uint64 above INT64_MAX goes to unsigned bound
+static
+void schema_integer(schema_node_t& node, const rapidjson::Value& json)
+{
+    if (json.IsInt64())
+    {
+        schema_range(node.minInt64, node.maxInt64, json.GetInt64(), !node.hasInt64);
+        node.hasInt64 = true;
+    }
+    else
+    {
+        schema_range(node.minUint64, node.maxUint64, json.GetUint64(), !node.hasUint64);
+        node.hasUint64 = true;
+    }
+}
+
+static
+void schema_enum(schema_node_t& node, const std::string& value, size_t maxEnum)
+{
+    if (node.enumOverflow)
+    {
+        return;
+    }
+    if (std::find(node.enums.begin(), node.enums.end(), value) != node.enums.end())
+    {
+        return;
+    }
+    if (node.enums.size() >= maxEnum)
+    {
+        node.enums.clear();
+        node.enums.shrink_to_fit();
+        node.enumOverflow = true;
+        return;
+    }
+    node.enums.push_back(value);
+}
+
+static
+void accumulate_schema(schema_node_t& node, const rapidjson::Value& json, size_t maxEnum)
+{
+    node.count++;
+    if (json.IsNull())
+    {
+        node.typeCount[SCHEMA_TYPE_NULL]++;
+    }
+    else if (json.IsBool())
+    {
+        node.typeCount[SCHEMA_TYPE_BOOLEAN]++;
+    }
+    else if (json.IsNumber())
+    {
+        bool first = node.typeCount[SCHEMA_TYPE_INTEGER] + node.typeCount[SCHEMA_TYPE_NUMBER] == 0;
+        bool integer = json.IsInt64() || json.IsUint64();
+        node.typeCount[integer ? SCHEMA_TYPE_INTEGER : SCHEMA_TYPE_NUMBER]++;
+        schema_range(node.minNumber, node.maxNumber, json.GetDouble(), first);
+        if (integer)
+        {
+            schema_integer(node, json);
+        }
+    }
+    else if (json.IsString())
+    {
+        bool first = node.typeCount[SCHEMA_TYPE_STRING] == 0;
+        node.typeCount[SCHEMA_TYPE_STRING]++;
+        size_t length = json.GetStringLength();
+        schema_range(node.minLength, node.maxLength, length, first);
+        if (!node.enumOverflow)
+        {
+            schema_enum(node, std::string(json.GetString(), length), maxEnum);
+        }
+    }
+    else if (json.IsObject())
+    {
+        node.typeCount[SCHEMA_TYPE_OBJECT]++;
+        for (auto it = json.MemberBegin(); it != json.MemberEnd(); ++it)
+        {
+            std::string name(it->name.GetString(), it->name.GetStringLength());
+            accumulate_schema(*node.Field(name), it->value, maxEnum);
+        }
+    }
+    else if (json.IsArray())
+    {
+        bool first = node.typeCount[SCHEMA_TYPE_ARRAY] == 0;
+        node.typeCount[SCHEMA_TYPE_ARRAY]++;
+        schema_range(node.minItems, node.maxItems, static_cast<size_t>(json.Size()), first);
+        for (auto it = json.Begin(); it != json.End(); ++it)
+        {
+            accumulate_schema(*node.Items(), *it, maxEnum);
+        }
+    }
+}
+
+static
+void merge_schema(schema_node_t& node, const schema_node_t& other, size_t maxEnum)
+{
+    size_t numbers = node.typeCount[SCHEMA_TYPE_INTEGER] + node.typeCount[SCHEMA_TYPE_NUMBER];
+    size_t otherNumbers = other.typeCount[SCHEMA_TYPE_INTEGER] + other.typeCount[SCHEMA_TYPE_NUMBER];
+    if (otherNumbers > 0)
+    {
+        schema_range(node.minNumber, node.maxNumber, other.minNumber, numbers == 0);
+        schema_range(node.minNumber, node.maxNumber, other.maxNumber, false);
+    }
+    if (other.hasInt64)
+    {
+        schema_range(node.minInt64, node.maxInt64, other.minInt64, !node.hasInt64);
+        schema_range(node.minInt64, node.maxInt64, other.maxInt64, false);
+        node.hasInt64 = true;
+    }
+    if (other.hasUint64)
+    {
+        schema_range(node.minUint64, node.maxUint64, other.minUint64, !node.hasUint64);
+        schema_range(node.minUint64, node.maxUint64, other.maxUint64, false);
+        node.hasUint64 = true;
+    }
+    if (other.typeCount[SCHEMA_TYPE_STRING] > 0)
+    {
+        schema_range(node.minLength, node.maxLength, other.minLength, node.typeCount[SCHEMA_TYPE_STRING] == 0);
+        schema_range(node.minLength, node.maxLength, other.maxLength, false);
+        if (other.enumOverflow)
+        {
+            node.enums.clear();
+            node.enumOverflow = true;
+        }
+        for (auto& value : other.enums)
+        {
+            schema_enum(node, value, maxEnum);
+        }
+    }
+    if (other.typeCount[SCHEMA_TYPE_ARRAY] > 0)
+    {
+        schema_range(node.minItems, node.maxItems, other.minItems, node.typeCount[SCHEMA_TYPE_ARRAY] == 0);
+        schema_range(node.minItems, node.maxItems, other.maxItems, false);
+    }
+
+    node.count += other.count;
+    for (int i = 0; i < SCHEMA_TYPE_COUNT; ++i)
+    {
+        node.typeCount[i] += other.typeCount[i];
+    }
+
+    for (auto& prop : other.props)
+    {
+        merge_schema(*node.Field(prop.first), *prop.second, maxEnum);
+    }
+    if (other.items)
+    {
+        merge_schema(*node.Items(), *other.items, maxEnum);
+    }
+}
+
+static
+void output_schema(const schema_node_t& node, rapidjson::Value& out,
+        rapidjson::Document::AllocatorType& allocator, double requiredRatio)
+{
+    out.SetObject();
+
+    bool hasNumber = node.typeCount[SCHEMA_TYPE_NUMBER] > 0;
+    rapidjson::Value types(rapidjson::kArrayType);
+    for (int i = 0; i < SCHEMA_TYPE_COUNT; ++i)
+    {
+        // integer is also number
+        if (node.typeCount[i] == 0 || (i == SCHEMA_TYPE_INTEGER && hasNumber))
+        {
+            continue;
+        }
+        types.PushBack(rapidjson::StringRef(s_schemaTypeName[i]), allocator);
+    }
+    if (types.Size() == 1)
+    {
+        out.AddMember("type", types[0], allocator);
+    }
+    else if (types.Size() > 1)
+    {
+        out.AddMember("type", types, allocator);
+    }
+
+    if (hasNumber)
+    {
+        out.AddMember("minimum", node.minNumber, allocator);
+        out.AddMember("maximum", node.maxNumber, allocator);
+    }
+    else if (node.typeCount[SCHEMA_TYPE_INTEGER] > 0)
+    {
+        rapidjson::Value minimum;
+        rapidjson::Value maximum;
+        if (node.hasInt64)
+        {
+            minimum.SetInt64(node.minInt64);
+        }
+        else
+        {
+            minimum.SetUint64(node.minUint64);
+        }
+        if (node.hasUint64)
+        {
+            maximum.SetUint64(node.maxUint64);
+        }
+        else
+        {
+            maximum.SetInt64(node.maxInt64);
+        }
+        out.AddMember("minimum", minimum, allocator);
+        out.AddMember("maximum", maximum, allocator);
+    }
+
+    size_t strings = node.typeCount[SCHEMA_TYPE_STRING];
+    if (strings > 0)
+    {
+        out.AddMember("minLength", static_cast<uint64_t>(node.minLength), allocator);
+        out.AddMember("maxLength", static_cast<uint64_t>(node.maxLength), allocator);
+        // only when the values repeat, it seems an enum;
+        // and any other type would fail the string only enum
+        if (!node.enumOverflow && strings > node.enums.size() && strings == node.count)
+        {
+            rapidjson::Value enums(rapidjson::kArrayType);
+            for (auto& value : node.enums)
+            {
+                enums.PushBack(rapidjson::Value(value.c_str(), value.size(), allocator), allocator);
+            }
+            out.AddMember("enum", enums, allocator);
+        }
+    }
+
+    size_t objects = node.typeCount[SCHEMA_TYPE_OBJECT];
+    if (objects > 0 && !node.props.empty())
+    {
+        rapidjson::Value properties(rapidjson::kObjectType);
+        rapidjson::Value required(rapidjson::kArrayType);
+        for (auto& prop : node.props)
+        {
+            rapidjson::Value item;
+            output_schema(*prop.second, item, allocator, requiredRatio);
+            properties.AddMember(rapidjson::Value(prop.first.c_str(), prop.first.size(), allocator), item, allocator);
+            if (prop.second->count >= requiredRatio * objects)
+            {
+                required.PushBack(rapidjson::Value(prop.first.c_str(), prop.first.size(), allocator), allocator);
+            }
+        }
+        out.AddMember("properties", properties, allocator);
+        if (!required.Empty())
+        {
+            out.AddMember("required", required, allocator);
+        }
+    }
+
+    if (node.typeCount[SCHEMA_TYPE_ARRAY] > 0)
+    {
+        out.AddMember("minItems", static_cast<uint64_t>(node.minItems), allocator);
+        out.AddMember("maxItems", static_cast<uint64_t>(node.maxItems), allocator);
+        if (node.items)
+        {
+            rapidjson::Value items;
+            output_schema(*node.items, items, allocator, requiredRatio);
+            out.AddMember("items", items, allocator);
+        }
+    }
+}
+
+} /* impl */
+
+CSchemaAccumulator::CSchemaAccumulator(size_t maxEnum, double requiredRatio)
+    : m_maxEnum(maxEnum), m_requiredRatio(requiredRatio), m_root(new impl::schema_node_t)
+{
+}
+
+CSchemaAccumulator::~CSchemaAccumulator()
+{
+    delete m_root;
+    m_root = nullptr;
+}
+
+void CSchemaAccumulator::Add(const rapidjson::Value& json)
+{
+    impl::accumulate_schema(*m_root, json, m_maxEnum);
+}
+
+bool CSchemaAccumulator::AddLine(const char* line, size_t len, rapidjson::MemoryPoolAllocator<>& allocator)
+{
+    while (len > 0 && (line[len-1] == '\r' || line[len-1] == ' ' || line[len-1] == '\t'))
+    {
+        --len;
+    }
+    if (len == 0)
+    {
+        return false;
+    }
+
+    bool ok = false;
+    {
+        rapidjson::Document doc(&allocator);
+        doc.Parse(line, len);
+        if (doc.HasParseError())
+        {
+            LOGF("skip bad json line(offset %u): %.*s", static_cast<unsigned>(doc.GetErrorOffset()),
+                    static_cast<int>(len < 64 ? len : 64), line);
+        }
+        else
+        {
+            Add(doc);
+            ok = true;
+        }
+    }
+    allocator.Clear();
+    return ok;
+}
+
+size_t CSchemaAccumulator::AddLines(const char* text, size_t len)
+{
+    rapidjson::MemoryPoolAllocator<> allocator;
+    size_t added = 0;
+    const char* end = text + len;
+    while (text < end)
+    {
+        const char* eol = static_cast<const char*>(memchr(text, '\n', end - text));
+        if (eol == nullptr)
+        {
+            eol = end;
+        }
+        if (AddLine(text, eol - text, allocator))
+        {
+            ++added;
+        }
+        text = eol + 1;
+    }
+    return added;
+}
+
+size_t CSchemaAccumulator::AddStream(std::istream& stream)
+{
+    rapidjson::MemoryPoolAllocator<> allocator;
+    size_t added = 0;
+    std::string line;
+    while (std::getline(stream, line))
+    {
+        if (AddLine(line.c_str(), line.size(), allocator))
+        {
+            ++added;
+        }
+    }
+    return added;
+}
+
+void CSchemaAccumulator::Merge(const CSchemaAccumulator& other)
+{
+    if (&other == this)
+    {
+        return;
+    }
+    impl::merge_schema(*m_root, *other.m_root, m_maxEnum);
+}
+
+size_t CSchemaAccumulator::Count() const
+{
+    return m_root->count;
+}
+
+bool CSchemaAccumulator::Output(rapidjson::Document& outSchema) const
+{
+    if (m_root->count == 0)
+    {
+        return false;
+    }
+    impl::output_schema(*m_root, outSchema, outSchema.GetAllocator(), m_requiredRatio);
+    return true;
+}
+
+} /* jsonkit */
+
+/* ************************************************************ */
+// random samples from schema
+
+namespace jsonkit
+{
+namespace impl
+{
+
+struct sample_option_t
+{
+    double optionalRatio;
+    size_t maxItems;
+    std::string* text; // reused buffer to build string value
+};
+
+// keywords that constrain the value but ignored by sampler
+static const char* s_sampleUnsupported[] = {
+    "$ref", "allOf", "anyOf", "oneOf", "not", "pattern", "format",
+    "multipleOf", "uniqueItems", "patternProperties", "dependencies",
+};
+
+// log the ignored keywords once when sampler is created
+static
+size_t sample_unsupported(const rapidjson::Value& schema, const std::string& path)
+{
+    if (!schema.IsObject())
+    {
+        return 0;
+    }
+    size_t count = 0;
+    for (auto keyword : s_sampleUnsupported)
+    {
+        if (schema.HasMember(keyword))
+        {
+            LOGF("sampler ignore keyword %s in schema: %s", keyword, path.c_str());
+            ++count;
+        }
+    }
+
+    auto& properties = schema/"properties";
+    if (!!properties && properties.IsObject())
+    {
+        for (auto it = properties.MemberBegin(); it != properties.MemberEnd(); ++it)
+        {
+            count += sample_unsupported(it->value, path + "/" + it->name.GetString());
+        }
+    }
+    auto& items = schema/"items";
+    if (!!items && items.IsArray())
+    {
+        for (rapidjson::SizeType i = 0; i < items.Size(); ++i)
+        {
+            count += sample_unsupported(items[i], path + "/" + std::to_string(i));
+        }
+    }
+    else if (!!items)
+    {
+        count += sample_unsupported(items, path + "/items");
+    }
+    return count;
+}
+
+// nested too deep, maybe recursive schema, stop with null
+static const int SAMPLE_MAX_DEPTH = 32;
+
+typedef rapidjson::MemoryPoolAllocator<> sample_allocator_t;
+
+static
+int64_t sample_integer(std::mt19937_64& random, int64_t low, int64_t high)
+{
+    if (high <= low)
+    {
+        return low;
+    }
+    std::uniform_int_distribution<int64_t> dist(low, high);
+    return dist(random);
+}
+
+static
+double sample_number(std::mt19937_64& random, double low, double high)
+{
+    if (high <= low)
+    {
+        return low;
+    }
+    std::uniform_real_distribution<double> dist(low, high);
+    return dist(random);
+}
+
+// read [minimum, maximum] from schema, with default span if not given
+static
+void sample_range(const rapidjson::Value& schema, double& low, double& high, double span)
+{
+    auto& minimum = schema/"minimum";
+    auto& maximum = schema/"maximum";
+    bool hasMin = !!minimum && minimum.IsNumber();
+    bool hasMax = !!maximum && maximum.IsNumber();
+    low = hasMin ? minimum.GetDouble() : (hasMax ? maximum.GetDouble() - span : 0);
+    high = hasMax ? maximum.GetDouble() : low + span;
+}
+
+static
+const char* sample_type(const rapidjson::Value& schema, std::mt19937_64& random)
+{
+    auto& type = schema/"type";
+    if (!!type && type.IsString())
+    {
+        return type.GetString();
+    }
+    if (!!type && type.IsArray() && !type.Empty())
+    {
+        auto& one = type[sample_integer(random, 0, type.Size() - 1)];
+        return one.IsString() ? one.GetString() : "null";
+    }
+    if (schema.HasMember("properties"))
+    {
+        return "object";
+    }
+    if (schema.HasMember("items"))
+    {
+        return "array";
+    }
+    return "null";
+}
+
+static
+void sample_json(const rapidjson::Value& schema, rapidjson::Value& out, sample_allocator_t& allocator,
+        std::mt19937_64& random, const sample_option_t& option, int depth);
+
+static
+void sample_string(const rapidjson::Value& schema, rapidjson::Value& out, sample_allocator_t& allocator,
+        std::mt19937_64& random, const sample_option_t& option)
+{
+    static const char s_chars[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+    size_t minLength = schema/"minLength" | 0;
+    size_t maxLength = schema/"maxLength" | static_cast<int>(minLength + 12);
+    size_t length = sample_integer(random, minLength, maxLength);
+
+    std::string& text = *option.text;
+    text.clear();
+    for (size_t i = 0; i < length; ++i)
+    {
+        text.push_back(s_chars[sample_integer(random, 0, sizeof(s_chars) - 2)]);
+    }
+    out.SetString(text.c_str(), length, allocator);
+}
+
+static
+void sample_object(const rapidjson::Value& schema, rapidjson::Value& out, sample_allocator_t& allocator,
+        std::mt19937_64& random, const sample_option_t& option, int depth)
+{
+    out.SetObject();
+    auto& properties = schema/"properties";
+    if (!properties || !properties.IsObject())
+    {
+        return;
+    }
+
+    auto& required = schema/"required";
+    for (auto it = properties.MemberBegin(); it != properties.MemberEnd(); ++it)
+    {
+        bool must = false;
+        if (!!required && required.IsArray())
+        {
+            for (auto name = required.Begin(); name != required.End(); ++name)
+            {
+                if (*name == it->name)
+                {
+                    must = true;
+                    break;
+                }
+            }
+        }
+        if (!must && sample_number(random, 0, 1) >= option.optionalRatio)
+        {
+            continue;
+        }
+
+        rapidjson::Value value;
+        sample_json(it->value, value, allocator, random, option, depth + 1);
+        // copy the key, the generated document may outlive the sampler
+        rapidjson::Value key(it->name.GetString(), it->name.GetStringLength(), allocator);
+        out.AddMember(key, value, allocator);
+    }
+}
+
+static
+void sample_array(const rapidjson::Value& schema, rapidjson::Value& out, sample_allocator_t& allocator,
+        std::mt19937_64& random, const sample_option_t& option, int depth)
+{
+    out.SetArray();
+    auto& items = schema/"items";
+    if (!!items && items.IsArray())
+    {
+        // tuple items
+        out.Reserve(items.Size(), allocator);
+        for (auto item = items.Begin(); item != items.End(); ++item)
+        {
+            rapidjson::Value value;
+            sample_json(*item, value, allocator, random, option, depth + 1);
+            out.PushBack(value, allocator);
+        }
+        return;
+    }
+
+    size_t minItems = schema/"minItems" | 0;
+    size_t maxItems = schema/"maxItems" | static_cast<int>(minItems + option.maxItems);
+    size_t count = sample_integer(random, minItems, maxItems);
+    out.Reserve(count, allocator);
+    for (size_t i = 0; i < count; ++i)
+    {
+        rapidjson::Value value;
+        if (!!items)
+        {
+            sample_json(items, value, allocator, random, option, depth + 1);
+        }
+        out.PushBack(value, allocator);
+    }
+}
+
+static
+void sample_json(const rapidjson::Value& schema, rapidjson::Value& out, sample_allocator_t& allocator,
+        std::mt19937_64& random, const sample_option_t& option, int depth)
+{
+    if (!schema.IsObject() || depth > SAMPLE_MAX_DEPTH)
+    {
+        out.SetNull();
+        return;
+    }
+
+    auto& valEnum = schema/"enum";
+    if (!!valEnum && valEnum.IsArray() && !valEnum.Empty())
+    {
+        out.CopyFrom(valEnum[sample_integer(random, 0, valEnum.Size() - 1)], allocator);
+        return;
+    }
+    auto& valConst = schema/"const";
+    if (!!valConst)
+    {
+        out.CopyFrom(valConst, allocator);
+        return;
+    }
+
+    const char* type = sample_type(schema, random);
+    if (strcmp(type, "integer") == 0)
+    {
+        double low = 0;
+        double high = 0;
+        sample_range(schema, low, high, 1000);
+        int64_t ilow = static_cast<int64_t>(std::ceil(low));
+        int64_t ihigh = static_cast<int64_t>(std::floor(high));
+        if (schema/"exclusiveMinimum" | false)
+        {
+            ilow = std::max(ilow, static_cast<int64_t>(std::floor(low)) + 1);
+        }
+        if (schema/"exclusiveMaximum" | false)
+        {
+            ihigh = std::min(ihigh, static_cast<int64_t>(std::ceil(high)) - 1);
+        }
+        out.SetInt64(sample_integer(random, ilow, ihigh));
+    }
+    else if (strcmp(type, "number") == 0)
+    {
+        double low = 0;
+        double high = 0;
+        sample_range(schema, low, high, 1000);
+        if (schema/"exclusiveMinimum" | false)
+        {
+            low = std::nextafter(low, HUGE_VAL);
+        }
+        if (schema/"exclusiveMaximum" | false)
+        {
+            high = std::nextafter(high, -HUGE_VAL);
+        }
+        out.SetDouble(sample_number(random, low, high));
+    }
+    else if (strcmp(type, "string") == 0)
+    {
+        sample_string(schema, out, allocator, random, option);
+    }
+    else if (strcmp(type, "boolean") == 0)
+    {
+        out.SetBool(sample_integer(random, 0, 1) == 1);
+    }
+    else if (strcmp(type, "object") == 0)
+    {
+        sample_object(schema, out, allocator, random, option, depth);
+    }
+    else if (strcmp(type, "array") == 0)
+    {
+        sample_array(schema, out, allocator, random, option, depth);
+    }
+    else
+    {
+        out.SetNull();
+    }
+}
+
+} /* impl */
+
+CSchemaSampler::CSchemaSampler(const rapidjson::Value& schema, uint64_t seed)
+    : m_random(seed)
+{
+    m_schema.CopyFrom(schema, m_schema.GetAllocator());
+    m_unsupported = impl::sample_unsupported(m_schema, "");
+}
+
+bool CSchemaSampler::Generate(rapidjson::Document& outJson)
+{
+    impl::sample_option_t option{m_optionalRatio, m_maxItems, &m_text};
+    impl::sample_json(m_schema, outJson, outJson.GetAllocator(), m_random, option, 0);
+    return true;
+}
+
+size_t CSchemaSampler::Stream(size_t count, const sample_sink_t& sink, size_t chunkBytes)
+{
+    impl::sample_option_t option{m_optionalRatio, m_maxItems, &m_text};
+    impl::sample_allocator_t allocator;
+    rapidjson::StringBuffer buffer;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+    std::string chunk;
+    chunk.reserve(chunkBytes + 1024);
+
+    size_t accepted = 0;
+    size_t lines = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        {
+            rapidjson::Value value;
+            impl::sample_json(m_schema, value, allocator, m_random, option, 0);
+            buffer.Clear();
+            writer.Reset(buffer);
+            value.Accept(writer);
+        }
+        allocator.Clear();
+
+        chunk.append(buffer.GetString(), buffer.GetSize());
+        chunk.push_back('\n');
+        ++lines;
+        if (chunk.size() >= chunkBytes)
+        {
+            if (!sink(chunk))
+            {
+                return accepted;
+            }
+            accepted += lines;
+            lines = 0;
+            chunk.clear();
+        }
+    }
+
+    if (!chunk.empty() && sink(chunk))
+    {
+        accepted += lines;
+    }
+    return accepted;
+}
+
+size_t CSchemaSampler::Stream(size_t count, std::ostream& stream)
+{
+    auto sink = [&stream](const std::string& chunk) {
+        stream.write(chunk.c_str(), chunk.size());
+        return stream.good();
+    };
+    return Stream(count, sink);
+}
+
+} /* jsonkit */
@@ -9,6 +9,12 @@
 
 #include "rapidjson/document.h"
 
+#include <functional>
+#include <iosfwd>
+#include <random>
+#include <string>
+#include <vector>
+
 namespace jsonkit
 {
     
@@ -18,6 +24,124 @@ namespace jsonkit
 bool form_schema(const rapidjson::Value& inJson, rapidjson::Document& outSchema);
 bool from_schema(const rapidjson::Value& inSchema, rapidjson::Document& outJson);
 
+namespace impl
+{
+struct schema_node_t;
+}
+
+/** accumulate schema from many json samples incrementally.
+ * @details form_schema() infers schema from only one sample, and only the
+ * first item for array. This class merges the observations of every sample
+ * and every array item into a tree of nodes, one node per distinct field:
+ * - type union, while integer is covered by number if both seen;
+ * - count of each field, a field is required if it occurs in at least
+ *   `requiredRatio` of the objects it belongs to;
+ * - minimum and maximum for number, exact int64 or uint64 for integer;
+ * - minLength and maxLength for string, and enum candidates that are
+ *   dropped once there are more than `maxEnum` distinct values, nor
+ *   output if the field is also seen as other type than string;
+ * - minItems and maxItems for array.
+ * So the memory is bounded by the number of distinct fields, not samples.
+ * Accumulators fed by different threads can be merged at last.
+ * @code
+ *   jsonkit::CSchemaAccumulator acc;
+ *   acc.AddStream(std::cin);
+ *   rapidjson::Document schema;
+ *   acc.Output(schema);
+ * @endcode
+ * */
+class CSchemaAccumulator
+{
+public:
+    CSchemaAccumulator(size_t maxEnum = 8, double requiredRatio = 1.0);
+    ~CSchemaAccumulator();
+
+    CSchemaAccumulator(const CSchemaAccumulator&) = delete;
+    CSchemaAccumulator& operator=(const CSchemaAccumulator&) = delete;
+
+    /// add one json sample
+    void Add(const rapidjson::Value& json);
+
+    /** add each line of NDJSON text as a sample, skip blank and bad lines.
+     * @return the number of samples added.
+     * */
+    size_t AddLines(const char* text, size_t len);
+    size_t AddStream(std::istream& stream);
+
+    /// merge the observations of another accumulator into this one
+    void Merge(const CSchemaAccumulator& other);
+
+    /// the number of samples added or merged
+    size_t Count() const;
+
+    /// output the json schema inferred from all samples so far
+    bool Output(rapidjson::Document& outSchema) const;
+
+private:
+    // parse one line and add, reuse the allocator for each line
+    bool AddLine(const char* line, size_t len, rapidjson::MemoryPoolAllocator<>& allocator);
+
+    size_t m_maxEnum;
+    double m_requiredRatio;
+    impl::schema_node_t* m_root;
+};
+
+/// receive a chunk of NDJSON lines from CSchemaSampler, return false to stop
+typedef std::function<bool(const std::string& chunk)> sample_sink_t;
+
+/** generate many varied sample json that satisfy a json schema.
+ * @details from_schema() generates only one fixed sample, this class
+ * generates random but valid values by a seeded random engine, so the same
+ * seed reproduces the same sequence. It understands these keywords:
+ * - type (or one of type array), enum, const;
+ * - minimum, maximum and exclusiveMinimum, exclusiveMaximum as bool;
+ * - minLength, maxLength;
+ * - properties and required, optional property is generated by chance;
+ * - items (single schema or tuple), minItems, maxItems.
+ * These keywords are not supported and ignored, so the samples may not be
+ * valid: $ref, allOf, anyOf, oneOf, not, pattern, format, multipleOf,
+ * uniqueItems, patternProperties, dependencies. They are logged when the
+ * sampler is created, and counted by Unsupported().
+ * It is not thread safe, use one sampler with different seed per thread.
+ * @code
+ *   jsonkit::CSchemaSampler sampler(docSchema, 20261019);
+ *   sampler.Stream(1000000, std::cout);
+ * @endcode
+ * */
+class CSchemaSampler
+{
+public:
+    CSchemaSampler(const rapidjson::Value& schema, uint64_t seed = 0);
+
+    void Seed(uint64_t seed) { m_random.seed(seed); }
+    /// the chance to generate an optional property, default 0.5
+    void OptionalRatio(double ratio) { m_optionalRatio = ratio; }
+    /// the max length of array if not limit by maxItems, default 5
+    void MaxItems(size_t count) { m_maxItems = count; }
+    /// the number of ignored keywords found in schema, 0 if fully supported
+    size_t Unsupported() const { return m_unsupported; }
+
+    /// generate one sample json
+    bool Generate(rapidjson::Document& outJson);
+
+    /** generate `count` samples as NDJSON, one condensed json per line.
+     * @param sink: receive chunks of about `chunkBytes`, of whole lines
+     * @return the number of samples accepted by sink
+     * @details Each sample is built in a reused pool allocator and written
+     * by a reused writer, so no memory is allocated per sample in steady.
+     * */
+    size_t Stream(size_t count, const sample_sink_t& sink, size_t chunkBytes = 64 * 1024);
+    size_t Stream(size_t count, std::ostream& stream);
+
+private:
+    rapidjson::Document m_schema;
+    std::mt19937_64 m_random;
+    double m_optionalRatio = 0.5;
+    size_t m_maxItems = 5;
+    size_t m_unsupported = 0;
+    std::string m_text;
+};
+
 /** validate the json according to schema
  * @param inJson: josn value 
  * @param inSchema: josn value/document as schema
@@ -29,6 +153,41 @@ bool from_schema(const rapidjson::Value& inSchema, rapidjson::Document& outJson)
 bool validate_schema(const rapidjson::Value& inJson, const rapidjson::Value& inSchema);
 bool validate_schema(const rapidjson::Value& inJson, const rapidjson::Value& inSchema, const std::string& basedir);
 
+/** parse and validate raw json text against schema in one pass.
+ * @param json, len: the raw json text, no DOM is built for it
+ * @param inSchema: josn value/document as schema
+ * @param basedir: is for remote reference in schema, empty if not used
+ * @return true if the text is well-formed and valid against the schema.
+ * @details Parsing stops early at the first schema violation.
+ * */
+bool validate_schema_text(const char* json, size_t len, const rapidjson::Value& inSchema, const std::string& basedir = "");
+
+/// the error of one invalid item found by validate_array()
+struct schema_item_error_t
+{
+    size_t index;
+    std::string error;
+};
+
+/// validate one item of array, return false and append to error if invalid
+typedef std::function<bool(const rapidjson::Value& item, std::string& error)> schema_item_fn;
+
+/** validate each item of a large json array in parallel.
+ * @param array: the json array to validate
+ * @param fn: validate one item, should be safe to call from multiple threads
+ * @param [OUT] errors: append every invalid item, sorted by index
+ * @param threads: max worker threads, 0 to use hardware concurrency
+ * @param stopEarly: stop all workers soon after the first invalid item
+ * @return true if all items are valid, false if any invalid or not array.
+ * @details The items are dispatched to workers in small chunks, so the load
+ * is balanced even if some items are much larger than others. When
+ * `stopEarly` is true, some more invalid items found by other workers at the
+ * same time may also be reported, not only the one with least index.
+ * @see CJsonSchema::ValidateArray(), CFlatSchemaCompiled::ValidateArray()
+ * */
+bool validate_array(const rapidjson::Value& array, const schema_item_fn& fn,
+        std::vector<schema_item_error_t>& errors, int threads = 0, bool stopEarly = false);
+
 /** validate json agaist one of non-standard schema
  * @param [IN] json, a json that must be object
  * @param [IN] schema, a json array where each item descibe one key that `inJson` should have
@@ -50,6 +209,85 @@ bool validate_schema(const rapidjson::Value& inJson, const rapidjson::Value& inS
 bool validate_flat_schema(const rapidjson::Value& json, const rapidjson::Value& schema);
 bool validate_flat_schema(const rapidjson::Value& json, const rapidjson::Value& schema, std::string& error, const rapidjson::Value* format = nullptr);
 
+namespace impl
+{
+struct flat_tree_t;
+}
+
+/** flat schema compiled once and used to validate many json.
+ * @details validate_flat_schema() interprets the schema json on each call,
+ * looking up every key of the schema items and comparing type strings.
+ * This class parses the flat schema only once into a typed node tree,
+ * with type as enum, number bounds converted and string pattern regex
+ * precompiled, then validate against that tree.
+ * It holds a deep copy of the schema and error format, so the source json
+ * can be released after construction.
+ * The Validate() methods are const, so one compiled object can be shared
+ * and used by multiple threads.
+ * @code
+ *   static jsonkit::CFlatSchemaCompiled s_schema(docSchema);
+ *   std::string error;
+ *   if (!s_schema.Validate(request, error)) { ... }
+ * @endcode
+ * */
+class CFlatSchemaCompiled
+{
+public:
+    CFlatSchemaCompiled() {}
+    CFlatSchemaCompiled(const rapidjson::Value& schema, const rapidjson::Value* format = nullptr);
+    ~CFlatSchemaCompiled();
+
+    CFlatSchemaCompiled(const CFlatSchemaCompiled&) = delete;
+    CFlatSchemaCompiled& operator=(const CFlatSchemaCompiled&) = delete;
+
+    /** (re)compile the flat schema, with optional error format.
+     * @return false if the schema is not array, then any validate fails.
+     * */
+    bool Compile(const rapidjson::Value& schema, const rapidjson::Value* format = nullptr);
+
+    /// whether a schema is compiled successfully.
+    bool Compiled() const { return m_tree != nullptr; }
+
+    /** validate json in boolean mode.
+     * @details No error context is built at all, neither the path nor the
+     * message, so the common valid input is checked as cheap as possible.
+     * */
+    bool Validate(const rapidjson::Value& json) const;
+
+    /** validate json and stop at the first error.
+     * @details The path is tracked as a stack of node and index, and the
+     * error message is only built when validation fails.
+     * */
+    bool Validate(const rapidjson::Value& json, std::string& error) const;
+
+    /** validate json and collect up to `maxErrors` errors.
+     * @param [OUT] errors: append the error messages
+     * @param maxErrors: stop after so many errors, 0 to check all
+     * */
+    bool Validate(const rapidjson::Value& json, std::vector<std::string>& errors, size_t maxErrors) const;
+
+    /** parse raw json text and validate in one pass, without DOM.
+     * @details The parser feeds SAX events to a handler, each key is matched
+     * by a trie of the names in its level while tokenized, and missing
+     * required keys are found by one bitmask check at the end of object.
+     * Unknown keys are skipped without building anything.
+     * The error message is the same as Validate(), but as keys are checked
+     * in the order of json text, the first error may be different from
+     * Validate() when there are many errors. If any name in schema is a
+     * json path contains '/', it falls back to parse DOM then Validate().
+     * */
+    bool ValidateText(const char* json, size_t len) const;
+    bool ValidateText(const char* json, size_t len, std::string& error) const;
+
+    /// validate each object in array against this schema in parallel.
+    /// @see validate_array()
+    bool ValidateArray(const rapidjson::Value& array, std::vector<schema_item_error_t>& errors,
+            int threads = 0, bool stopEarly = false) const;
+
+private:
+    impl::flat_tree_t* m_tree = nullptr;
+};
+
 } /* jsonkit */ 
 
 #endif /* end of include guard: JSON_SCHEMA_H__ */
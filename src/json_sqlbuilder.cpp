@@ -1,7 +1,27 @@
 #include "json_sqlbuilder.h"
 #include "json_operator.h"
+#include "json_output.h"
 #include "jsonkit_internal.h"
 
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <errno.h>
+#include <string.h>
+#include <thread>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
 #define SQL_ASSERT(expr) do { \
     if (!expr) { \
         LOGF("build sql failed: %s", #expr); \
@@ -15,23 +35,198 @@ namespace jsonkit
 /* ************************************************************ */
 // static helper functions
 
-static sql_config_t s_config;
+/** the default config, replaced as a whole snapshot that never change */
+static sql_config_ptr s_config = std::make_shared<sql_config_t>();
+/** increased after each replace of default config */
+static std::atomic<uint64_t> s_configVersion(1);
+
+sql_config_ptr get_sql_config()
+{
+    return std::atomic_load(&s_config);
+}
 
 sql_config_t set_sql_config(const sql_config_t* cfg)
 {
     if (!cfg)
     {
-        return s_config;
+        return *get_sql_config();
+    }
+    sql_config_ptr old = std::atomic_exchange(&s_config, sql_config_ptr(std::make_shared<sql_config_t>(*cfg)));
+    s_configVersion.fetch_add(1, std::memory_order_release);
+    return *old;
+}
+
+/** the default config snapshot cached in each thread.
+ * @details Only reload by atomic_load() when the version changed, so
+ * the common path is one atomic load of integer, without the lock inside
+ * atomic_load() of shared_ptr nor the reference count.
+ * The pointer is valid until the next call in the same thread after the
+ * default config is replaced, nested builder should pass its config.
+ * */
+static const sql_config_t* default_sql_config()
+{
+    struct cache_t
+    {
+        uint64_t version = 0;
+        sql_config_ptr config;
+    };
+    static thread_local cache_t t_cache;
+
+    uint64_t version = s_configVersion.load(std::memory_order_acquire);
+    if (t_cache.version != version)
+    {
+        t_cache.config = std::atomic_load(&s_config);
+        t_cache.version = version;
+    }
+    return t_cache.config.get();
+}
+
+sql_config_t sql_dialect_config(short dialect)
+{
+    sql_config_t cfg;
+    cfg.dialect = dialect;
+    if (dialect == SQL_DIALECT_POSTGRES)
+    {
+        cfg.placeholder = SQL_PLACEHOLDER_DOLLAR;
     }
-    sql_config_t old = s_config;
-    s_config = *cfg;
-    return old;
+    return cfg;
 }
 
 const char SINGLE_QUOTE = '\'';
 const char BACK_QUOTE = '`';
 const char STATE_END = ';';
 
+/** the field list in insert json, "head" is alias of "field" */
+static const rapidjson::Value& insert_field(const rapidjson::Value& json)
+{
+    auto& field = json/"field";
+    if (!!field)
+    {
+        return field;
+    }
+    return json/"head";
+}
+
+/* ************************************************************ */
+// Section: string escape scan
+
+/** char need escape in quoted string */
+const unsigned char ESCAPE_QUOTE = 1;
+/** char need escape in like pattern, single quote is also included */
+const unsigned char ESCAPE_LIKE = 2;
+/** char need escape in quoted string if escape_backslash, also backslash */
+const unsigned char ESCAPE_BACKSLASH = 4;
+const char BACK_SLASH = '\\';
+const char LIKE_METACHAR[] = "\\%_?*[]";
+
+/** lookup table for scalar scan of the tail or without simd */
+struct escape_table_t
+{
+    unsigned char flag[256];
+    escape_table_t()
+    {
+        memset(flag, 0, sizeof(flag));
+        flag[(unsigned char)SINGLE_QUOTE] = ESCAPE_QUOTE | ESCAPE_LIKE | ESCAPE_BACKSLASH;
+        flag[(unsigned char)BACK_SLASH] = ESCAPE_BACKSLASH;
+        for (const char* p = LIKE_METACHAR; *p != '\0'; ++p)
+        {
+            flag[(unsigned char)*p] |= ESCAPE_LIKE;
+        }
+    }
+};
+static const escape_table_t s_escapeTable;
+
+#if defined(__SSE2__)
+static inline int escape_mask(__m128i block, unsigned char kind)
+{
+    __m128i hit = _mm_cmpeq_epi8(block, _mm_set1_epi8(SINGLE_QUOTE));
+    if (kind == ESCAPE_LIKE)
+    {
+        for (const char* p = LIKE_METACHAR; *p != '\0'; ++p)
+        {
+            hit = _mm_or_si128(hit, _mm_cmpeq_epi8(block, _mm_set1_epi8(*p)));
+        }
+    }
+    else if (kind == ESCAPE_BACKSLASH)
+    {
+        hit = _mm_or_si128(hit, _mm_cmpeq_epi8(block, _mm_set1_epi8(BACK_SLASH)));
+    }
+    return _mm_movemask_epi8(hit);
+}
+#endif
+
+#if defined(__AVX2__)
+static inline int escape_mask(__m256i block, unsigned char kind)
+{
+    __m256i hit = _mm256_cmpeq_epi8(block, _mm256_set1_epi8(SINGLE_QUOTE));
+    if (kind == ESCAPE_LIKE)
+    {
+        for (const char* p = LIKE_METACHAR; *p != '\0'; ++p)
+        {
+            hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(block, _mm256_set1_epi8(*p)));
+        }
+    }
+    else if (kind == ESCAPE_BACKSLASH)
+    {
+        hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(block, _mm256_set1_epi8(BACK_SLASH)));
+    }
+    return _mm256_movemask_epi8(hit);
+}
+#endif
+
+/** find the first char need escape.
+ * @param kind: ESCAPE_QUOTE, ESCAPE_LIKE or ESCAPE_BACKSLASH
+ * @return the offset of that char, or count if not found.
+ * @details Scan 32 or 16 bytes at a time when compiled with AVX2 or SSE2
+ * enabled, and the tail bytes by lookup table.
+ * */
+static size_t escape_scan(const char* psz, size_t count, unsigned char kind)
+{
+    size_t i = 0;
+#if defined(__AVX2__)
+    for (; i + 32 <= count; i += 32)
+    {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(psz + i));
+        int mask = escape_mask(block, kind);
+        if (mask != 0)
+        {
+            return i + __builtin_ctz(mask);
+        }
+    }
+#endif
+#if defined(__SSE2__)
+    for (; i + 16 <= count; i += 16)
+    {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(psz + i));
+        int mask = escape_mask(block, kind);
+        if (mask != 0)
+        {
+            return i + __builtin_ctz(mask);
+        }
+    }
+#endif
+    for (; i < count; ++i)
+    {
+        if (s_escapeTable.flag[(unsigned char)psz[i]] & kind)
+        {
+            break;
+        }
+    }
+    return i;
+}
+
+/** value omitted from sql template, insert later when render */
+const short SQL_SLOT_VALUE = 0;
+/** like pattern omitted from sql template */
+const short SQL_SLOT_LIKE = 1;
+
+/** the position in sql template where to insert value */
+struct sql_slot_t
+{
+    size_t pos;
+    short kind;
+};
+
 /* ************************************************************ */
 // Section:
 
@@ -43,12 +238,12 @@ const char STATE_END = ';';
 class CSqlBuildBuffer
 {
 public:
-    CSqlBuildBuffer(std::string& buffer, sql_config_t* pConfig = nullptr)
-        : m_buffer(buffer), m_pConfig(pConfig)
+    CSqlBuildBuffer(std::string& buffer, const sql_config_t* pConfig = nullptr)
+        : m_pConfig(pConfig), m_buffer(buffer)
     {
         if (!m_pConfig)
         {
-            m_pConfig = &s_config;
+            m_pConfig = default_sql_config();
         }
     }
 
@@ -56,6 +251,12 @@ public:
     CSqlBuildBuffer(const SelfType& that) =  delete;
     SelfType& operator=(const SelfType& that) = delete;
 
+    /** turn on prepared statement mode, bind value to params */
+    void SetParams(sql_param_t* pParams) { m_pParams = pParams; }
+    /** turn on template mode, omit value but record the slot position,
+     * should also set params to collect the omitted value */
+    void SetSlots(std::vector<sql_slot_t>* pSlots) { m_pSlots = pSlots; }
+
     size_t Size() { return m_buffer.size(); }
     const char* c_str() { return m_buffer.c_str(); }
     const std::string& Buffer() { return m_buffer; }
@@ -122,6 +323,10 @@ public:
     bool LikeEscape(const rapidjson::Value& json);
     bool PutValue(const char* psz, size_t count);
     bool PutValue(const rapidjson::Value& json);
+    bool BindValue(const rapidjson::Value& json);
+    void PutPlaceholder();
+    bool LikeBind(const rapidjson::Value& json);
+    bool PutLike(const rapidjson::Value& json);
 
     bool PushTable(const rapidjson::Value& json);
     bool PushField(const rapidjson::Value& json);
@@ -131,16 +336,22 @@ public:
     bool DoSetValue(const rapidjson::Value& json);
     bool DoBatchValue(const rapidjson::Value& json);
 
-    bool DoPushWhere(const rapidjson::Value& json, const char* relation = nullptr);
-    bool DoCmpWhere(const rapidjson::Value& json, const std::string& field, const char* relation = nullptr);
+    void Relation(const char* relation, bool& first);
+    bool DoPushWhere(const rapidjson::Value& json, const char* relation, bool& first);
+    bool DoGroupWhere(const rapidjson::Value& json, const char* relation, const char* inner, bool& first);
+    bool DoCmpWhere(const rapidjson::Value& json, const rapidjson::Value& field, const char* relation, bool& first);
     bool PushWhere(const rapidjson::Value& json);
     bool PushHaving(const rapidjson::Value& json);
     bool PushGroup(const rapidjson::Value& json);
     bool PushOrder(const rapidjson::Value& json);
     bool PushLimit(const rapidjson::Value& json);
+    bool PushUpsert(const rapidjson::Value& json, bool replace = false);
+    bool PushExcluded(const rapidjson::Value& json);
+
+    bool IsPostgres() const { return m_pConfig->dialect == SQL_DIALECT_POSTGRES; }
 
 protected:
-    bool DoInsert(const rapidjson::Value& json);
+    bool DoInsert(const rapidjson::Value& json, bool replace = false);
 
 public: // user interface for typical sql statements
 
@@ -151,6 +362,11 @@ public: // user interface for typical sql statements
     }
     bool Replace(const rapidjson::Value& json)
     {
+        if (IsPostgres())
+        {
+            Append("INSERT INTO ");
+            return DoInsert(json, true);
+        }
         Append("REPLACE INTO ");
         return DoInsert(json);
     }
@@ -161,8 +377,10 @@ public: // user interface for typical sql statements
     bool Delete(const rapidjson::Value& json);
 
 protected:
-    sql_config_t* m_pConfig;
+    const sql_config_t* m_pConfig;
     std::string& m_buffer;
+    sql_param_t* m_pParams = nullptr;
+    std::vector<sql_slot_t>* m_pSlots = nullptr;
 };
 
 bool CSqlBuildBuffer::PutWord(const char* psz, size_t count)
@@ -185,32 +403,55 @@ bool CSqlBuildBuffer::PutWord(const char* psz, size_t count)
     return true;
 }
 
+/** copy clean run in bulk, and only escape the found char */
 bool CSqlBuildBuffer::PutEscape(const char* psz, size_t count)
 {
-    for (size_t i = 0; i < count; ++i)
-    {
-        char ch = psz[i];
-        // escape single quote: ' --> ''
-        if (ch == SINGLE_QUOTE)
+    m_buffer.reserve(m_buffer.size() + count + 2);
+    unsigned char kind = m_pConfig->escape_backslash ? ESCAPE_BACKSLASH : ESCAPE_QUOTE;
+    size_t i = 0;
+    while (i < count)
+    {
+        size_t run = escape_scan(psz + i, count - i, kind);
+        Append(psz + i, run);
+        i += run;
+        if (i < count)
         {
-            Append(ch);
+            // escape single quote: ' --> '', and \ --> \\ if escape_backslash
+            Append(psz[i]).Append(psz[i]);
+            ++i;
         }
-        Append(ch);
     }
     return true;
 }
 
 bool CSqlBuildBuffer::LikeEscape(const char* psz, size_t count)
 {
-    std::string metachar = "\\%_?*[]";
-    for (size_t i = 0; i < count; ++i)
-    {
-        char ch = psz[i];
-        if (metachar.find(ch) != std::string::npos)
+    m_buffer.reserve(m_buffer.size() + count + 4);
+    size_t i = 0;
+    while (i < count)
+    {
+        size_t run = escape_scan(psz + i, count - i, ESCAPE_LIKE);
+        Append(psz + i, run);
+        i += run;
+        if (i < count)
         {
-            Append('\\');
+            char ch = psz[i];
+            if (ch == SINGLE_QUOTE)
+            {
+                Append(SINGLE_QUOTE);
+            }
+            else if (ch == BACK_SLASH && m_pConfig->escape_backslash)
+            {
+                // string literal unescape backslash before like does
+                Append("\\\\\\");
+            }
+            else
+            {
+                Append(BACK_SLASH);
+            }
+            Append(ch);
+            ++i;
         }
-        Append(ch);
     }
     return true;
 }
@@ -300,6 +541,11 @@ bool CSqlBuildBuffer::PutWord(const rapidjson::Value& json, std::string& last)
 
 bool CSqlBuildBuffer::PutValue(const rapidjson::Value& json)
 {
+    if (m_pParams && BindValue(json))
+    {
+        return true;
+    }
+
     if (json.IsString())
     {
         return PutValue(json.GetString(), json.GetStringLength());
@@ -345,6 +591,126 @@ bool CSqlBuildBuffer::PutValue(const rapidjson::Value& json)
     return true;
 }
 
+void CSqlBuildBuffer::PutPlaceholder()
+{
+    if (m_pSlots)
+    {
+        m_pSlots->push_back({Size(), SQL_SLOT_VALUE});
+        return;
+    }
+    if (m_pConfig->placeholder == SQL_PLACEHOLDER_DOLLAR)
+    {
+        Append('$').Append(std::to_string(m_pParams->size()));
+    }
+    else
+    {
+        Append('?');
+    }
+}
+
+/** bind scalar value to placeholder in prepared statement mode.
+ * @return false if the value should still be put inline, as null, raw
+ * string in `` quote, or array that will bind it's items one by one.
+ * */
+bool CSqlBuildBuffer::BindValue(const rapidjson::Value& json)
+{
+    if (json.IsString())
+    {
+        if (json.GetStringLength() > 0 && json.GetString()[0] == BACK_QUOTE)
+        {
+            return false;
+        }
+    }
+    else if (!json.IsNumber() && !json.IsBool())
+    {
+        return false;
+    }
+
+    m_pParams->push_back(&json);
+    PutPlaceholder();
+    return true;
+}
+
+/** bind like pattern, add '%' by CONCAT('%', ?, '%') as config.
+ * @note PostgreSQL cannot infer the type of parameter in variadic CONCAT,
+ * so use '%' || $n || '%' instead.
+ * */
+bool CSqlBuildBuffer::LikeBind(const rapidjson::Value& json)
+{
+    if (!json.IsString())
+    {
+        return false;
+    }
+
+    if (m_pSlots)
+    {
+        m_pParams->push_back(&json);
+        m_pSlots->push_back({Size(), SQL_SLOT_LIKE});
+        return true;
+    }
+
+    bool prefix = (m_pConfig->fix_like_value & SQL_LIKE_PREFIX) != 0;
+    bool postfix = (m_pConfig->fix_like_value & SQL_LIKE_POSTFIX) != 0;
+    if (IsPostgres())
+    {
+        if (prefix)
+        {
+            Append("'%'||");
+        }
+        m_pParams->push_back(&json);
+        PutPlaceholder();
+        if (postfix)
+        {
+            Append("||'%'");
+        }
+        return true;
+    }
+
+    if (prefix || postfix)
+    {
+        Append("CONCAT(");
+    }
+    if (prefix)
+    {
+        Append("'%',");
+    }
+    m_pParams->push_back(&json);
+    PutPlaceholder();
+    if (postfix)
+    {
+        Append(",'%'");
+    }
+    if (prefix || postfix)
+    {
+        Append(')');
+    }
+    return true;
+}
+
+/** put like pattern in quote, add '%' as config */
+bool CSqlBuildBuffer::PutLike(const rapidjson::Value& json)
+{
+    Append(SINGLE_QUOTE);
+    if (m_pConfig->fix_like_value & SQL_LIKE_PREFIX)
+    {
+        Append('%');
+    }
+    if (m_pConfig->escape_like_metachar)
+    {
+        SQL_ASSERT(LikeEscape(json));
+    }
+    else
+    {
+        SQL_ASSERT(PutEscape(json));
+    }
+    if (m_pConfig->fix_like_value & SQL_LIKE_POSTFIX)
+    {
+        Append('%');
+    }
+    Append(SINGLE_QUOTE);
+    return true;
+}
+
 bool CSqlBuildBuffer::PushTable(const rapidjson::Value& json)
 {
     if (json.IsString())
@@ -464,11 +830,12 @@ bool CSqlBuildBuffer::DoSetValue(const rapidjson::Value& json)
 }
 
 /** Generate: (field1, feild2, ...) VALUES (value1, value2, ...), ...
- * @param json: array of object which has the same fields set
+ * @param json: array of object which has the same fields set, or a single
+ * object as one row.
  * */
 bool CSqlBuildBuffer::DoBatchValue(const rapidjson::Value& json)
 {
-    auto& first = json[0];
+    auto& first = json.IsArray() ? json[0] : json;
     if (!first.IsObject() || first.ObjectEmpty())
     {
         return false;
@@ -478,6 +845,9 @@ bool CSqlBuildBuffer::DoBatchValue(const rapidjson::Value& json)
     std::vector<std::string> field;
     std::string value; // store first row value with field
     CSqlBuildBuffer another(value, m_pConfig);
+    another.SetParams(m_pParams);
+    another.SetSlots(m_pSlots);
+    size_t slotStart = m_pSlots ? m_pSlots->size() : 0;
     Append('(');
     another.Append('(');
     for (auto it = first.MemberBegin(); it != first.MemberEnd(); ++it)
@@ -501,9 +871,17 @@ bool CSqlBuildBuffer::DoBatchValue(const rapidjson::Value& json)
     another.Append(')');
 
     Append(" VALUES ");
+    if (m_pSlots)
+    {
+        // slot in the first row is relative to another buffer
+        for (size_t i = slotStart; i < m_pSlots->size(); ++i)
+        {
+            (*m_pSlots)[i].pos += Size();
+        }
+    }
     Append(value);
 
-    uint32_t size = json.Size();
+    uint32_t size = json.IsArray() ? json.Size() : 1;
     for (uint32_t i = 1; i < size; ++i)
     {
         Append(", (");
@@ -577,7 +955,8 @@ bool CSqlBuildBuffer::PushWhere(const rapidjson::Value& json)
     }
 
     Append(" WHERE 1=1");
-    return DoPushWhere(json);
+    bool first = false;
+    return DoPushWhere(json, " AND ", first);
 }
 
 bool CSqlBuildBuffer::PushHaving(const rapidjson::Value& json)
@@ -588,7 +967,106 @@ bool CSqlBuildBuffer::PushHaving(const rapidjson::Value& json)
     }
 
     Append(" HAVING 1=1");
-    return DoPushWhere(json);
+    bool first = false;
+    return DoPushWhere(json, " AND ", first);
+}
+
+/** compare operator in where */
+enum sql_op_t
+{
+    SQL_OP_UNKNOWN = 0,
+    SQL_OP_EQ,
+    SQL_OP_NE,
+    SQL_OP_GT,
+    SQL_OP_LT,
+    SQL_OP_GE,
+    SQL_OP_LE,
+    SQL_OP_IN,
+    SQL_OP_NOT_IN,
+    SQL_OP_LIKE,
+    SQL_OP_NOT_LIKE,
+    SQL_OP_REGEXP,
+    SQL_OP_BETWEEN,
+    SQL_OP_NULL,
+};
+
+struct sql_op_name_t
+{
+    const char* name;
+    const char* sql;
+};
+
+/** operator name in json and sql, index by sql_op_t */
+static const sql_op_name_t s_sqlOpName[] = {
+    {"", ""},
+    {"eq", "="},
+    {"ne", "!="},
+    {"gt", ">"},
+    {"lt", "<"},
+    {"ge", ">="},
+    {"le", "<="},
+    {"in", " IN "},
+    {"not in", " not IN "},
+    {"like", " like "},
+    {"not like", " not like "},
+    {"regexp", " REGEXP "},
+    {"between", " BETWEEN "},
+    {"null", ""},
+};
+
+/** find operator by perfect hash of name length and first two chars,
+ * then verify the whole name once.
+ * */
+static sql_op_t sql_op_find(const char* name, size_t len)
+{
+    sql_op_t op = SQL_OP_UNKNOWN;
+    switch (len)
+    {
+    case 2:
+        switch (name[0])
+        {
+        case 'e': op = SQL_OP_EQ; break;
+        case 'n': op = SQL_OP_NE; break;
+        case 'g': op = (name[1] == 't') ? SQL_OP_GT : SQL_OP_GE; break;
+        case 'l': op = (name[1] == 't') ? SQL_OP_LT : SQL_OP_LE; break;
+        case 'i': op = SQL_OP_IN; break;
+        default: break;
+        }
+        break;
+    case 4:
+        op = (name[0] == 'l') ? SQL_OP_LIKE : SQL_OP_NULL;
+        break;
+    case 6:
+        op = (name[0] == 'n') ? SQL_OP_NOT_IN : SQL_OP_REGEXP;
+        break;
+    case 7:
+        op = SQL_OP_BETWEEN;
+        break;
+    case 8:
+        op = SQL_OP_NOT_LIKE;
+        break;
+    default:
+        break;
+    }
+
+    if (op != SQL_OP_UNKNOWN && 0 != memcmp(name, s_sqlOpName[op].name, len))
+    {
+        op = SQL_OP_UNKNOWN;
+    }
+    return op;
+}
+
+/** put relation before predicate except the first one */
+void CSqlBuildBuffer::Relation(const char* relation, bool& first)
+{
+    if (first)
+    {
+        first = false;
+    }
+    else
+    {
+        Append(relation);
+    }
 }
 
 /** generate where statemnet if possible, otherwise emtpy stirng on failure
@@ -599,17 +1077,17 @@ bool CSqlBuildBuffer::PushHaving(const rapidjson::Value& json)
  *   "field3" : {             // AND field3 > min-value AND field3 < max-value
  *     "gt" : "min-value",
  *     "lt" : "max-value"
- *   }
+ *   },
+ *   "-or" : {...},           // AND (... OR ...)
+ *   "-and" : [{...}, {...}]  // AND ((...) AND (...))
  * }
  * @endcode 
+ * @param relation: put between each predicate.
+ * @param first: if no predicate before, not put relation, and set to
+ * false after put any predicate.
  * */
-bool CSqlBuildBuffer::DoPushWhere(const rapidjson::Value& json, const char* relation)
+bool CSqlBuildBuffer::DoPushWhere(const rapidjson::Value& json, const char* relation, bool& first)
 {
-    if (relation == nullptr)
-    {
-        relation = " AND ";
-    }
-
     for (auto it = json.MemberBegin(); it != json.MemberEnd(); ++it)
     {
         if (it->value.IsNull())
@@ -617,34 +1095,101 @@ bool CSqlBuildBuffer::DoPushWhere(const rapidjson::Value& json, const char* rela
             continue;
         }
 
-        std::string field;
-        CSqlBuildBuffer another(field, m_pConfig);
-        SQL_ASSERT(another.PutWord(it->name));
-
-        if (it->value.IsArray())
+        const char* name = it->name.GetString();
+        size_t len = it->name.GetStringLength();
+        if (len == 3 && 0 == memcmp(name, "-or", 3))
+        {
+            SQL_ASSERT(DoGroupWhere(it->value, relation, " OR ", first));
+        }
+        else if (len == 4 && 0 == memcmp(name, "-and", 4))
+        {
+            SQL_ASSERT(DoGroupWhere(it->value, relation, " AND ", first));
+        }
+        else if (it->value.IsArray())
         {
-            Append(relation).Append(field).Append(" IN ");
+            Relation(relation, first);
+            SQL_ASSERT(PutWord(it->name));
+            Append(" IN ");
             SQL_ASSERT(PutValue(it->value));
         }
         else if (it->value.IsObject())
         {
-            if (field == "-or")
+            SQL_ASSERT(DoCmpWhere(it->value, it->name, relation, first));
+        }
+        else
+        {
+            Relation(relation, first);
+            SQL_ASSERT(PutWord(it->name));
+            Append('=');
+            SQL_ASSERT(PutValue(it->value));
+        }
+    }
+    return true;
+}
+
+/** Generate predicate group in parenthesis.
+ * @param relation: relation before the group.
+ * @param inner: relation between predicates in group.
+ * @details Group of object joins each member by inner relation, while
+ * group of array joins each item by inner relation, and the members of
+ * each item object by AND. Null member or item with only null members is
+ * ignored. Then empty AND group generates nothing as it is always true,
+ * while empty OR group generates `(1!=1)` as it matches nothing.
+ * */
+bool CSqlBuildBuffer::DoGroupWhere(const rapidjson::Value& json, const char* relation, const char* inner, bool& first)
+{
+    size_t mark = Size();
+    bool firstMark = first;
+    Relation(relation, first);
+    Append('(');
+
+    bool groupFirst = true;
+    if (json.IsObject())
+    {
+        SQL_ASSERT(DoPushWhere(json, inner, groupFirst));
+    }
+    else if (json.IsArray())
+    {
+        for (auto it = json.Begin(); it != json.End(); ++it)
+        {
+            if (!it->IsObject())
             {
-                Append(" AND (1!=1");
-                SQL_ASSERT(DoPushWhere(it->value, " OR "));
-                Append(")");
+                return false;
+            }
+            size_t itemMark = Size();
+            bool itemFirstMark = groupFirst;
+            Relation(inner, groupFirst);
+            Append('(');
+            bool itemFirst = true;
+            SQL_ASSERT(DoPushWhere(*it, " AND ", itemFirst));
+            if (itemFirst)
+            {
+                m_buffer.resize(itemMark);
+                groupFirst = itemFirstMark;
             }
             else
             {
-                SQL_ASSERT(DoCmpWhere(it->value, field, relation));
+                Append(')');
             }
         }
-        else
+    }
+    else
+    {
+        return false;
+    }
+
+    if (groupFirst)
+    {
+        if (strcmp(inner, " OR ") == 0)
         {
-            Append(relation).Append(field).Append('=');
-            SQL_ASSERT(PutValue(it->value));
+            Append("1!=1)");
+            return true;
         }
+        m_buffer.resize(mark);
+        first = firstMark;
+        return true;
     }
+    Append(')');
     return true;
 }
 
@@ -653,121 +1198,109 @@ bool CSqlBuildBuffer::DoPushWhere(const rapidjson::Value& json, const char* rela
  * "field": {
  *   "eq": ..., "ne": ..., "gt": ..., "lt": ..., "ge": ..., "le": ...,
  *   "between": [min, max]
- *   "like": ..., "not in": [...], 
+ *   "like": ..., "not like": ..., "regexp": ...,
+ *   "in": [...], "not in": [...], 
  *   "null": true/false
  * }
  * @endcode
+ * Unknown operator is ignored, except sub-select query as value, which
+ * use the operator verbatim, such as "in", "not in", "exists".
  * */
-bool CSqlBuildBuffer::DoCmpWhere(const rapidjson::Value& json, const std::string& field, const char* relation)
+bool CSqlBuildBuffer::DoCmpWhere(const rapidjson::Value& json, const rapidjson::Value& field, const char* relation, bool& first)
 {
-    if (relation == nullptr)
-    {
-        relation = " AND ";
-    }
     for (auto it = json.MemberBegin(); it != json.MemberEnd(); ++it)
     {
-        if (it->value.IsNull())
+        const rapidjson::Value& value = it->value;
+        if (value.IsNull())
+        {
+            continue;
+        }
+
+        // sub-select query in where
+        if (value.IsObject())
         {
+            Relation(relation, first);
+            SQL_ASSERT(PutWord(field));
+            Append(' ');
+            SQL_ASSERT(PutWord(it->name));
+            Append(" (");
+            SQL_ASSERT(Select(value));
+            Append(')');
             continue;
         }
 
-        const char* op = it->name.GetString();
-        if (0 == strcmp(op, "like"))
+        sql_op_t op = sql_op_find(it->name.GetString(), it->name.GetStringLength());
+        switch (op)
         {
-            Append(relation).Append(field).Append(" like ");
-            Append(SINGLE_QUOTE);
-            if (m_pConfig->fix_like_value & SQL_LIKE_PREFIX)
+        case SQL_OP_LIKE:
+        case SQL_OP_NOT_LIKE:
+            Relation(relation, first);
+            SQL_ASSERT(PutWord(field));
+            Append(s_sqlOpName[op].sql);
+            if (m_pSlots || (m_pParams && !m_pConfig->escape_like_metachar))
             {
-                Append('%');
+                SQL_ASSERT(LikeBind(value));
             }
-            if (m_pConfig->escape_like_metachar)
+            else
             {
-                SQL_ASSERT(LikeEscape(it->value));
+                SQL_ASSERT(PutLike(value));
             }
-            else
+            break;
+        case SQL_OP_BETWEEN:
+            if (value.IsArray() && value.Size() == 2)
             {
-                SQL_ASSERT(PutEscape(it->value));
+                Relation(relation, first);
+                SQL_ASSERT(PutWord(field));
+                Append(s_sqlOpName[op].sql);
+                SQL_ASSERT(PutValue(value[0]));
+                Append(" AND ");
+                SQL_ASSERT(PutValue(value[1]));
             }
-            if (m_pConfig->fix_like_value & SQL_LIKE_POSTFIX)
+            break;
+        case SQL_OP_NULL:
+            Relation(relation, first);
+            SQL_ASSERT(PutWord(field));
+            if (value.IsBool() && value.GetBool())
             {
-                Append('%');
+                Append(" is NULL");
             }
-            Append(SINGLE_QUOTE);
-            continue;
-        }
-
-        if (0 == strcmp(op, "between"))
-        {
-            if (it->value.IsArray() && it->value.Size() == 2)
+            else
             {
-                Append(relation).Append(field).Append(" BETWEEN ");
-                SQL_ASSERT(PutValue(it->value[0]));
-                Append(relation);
-                SQL_ASSERT(PutValue(it->value[1]));
+                Append(" is not NULL");
             }
-            continue;
-        }
-
-        if (0 == strcmp(op, "null"))
-        {
-            if (it->value.IsBool() && it->value.GetBool())
+            break;
+        case SQL_OP_NOT_IN:
+            if (!value.IsArray() || value.Empty())
             {
-                Append(relation).Append(field).Append(" is NULL");
+                break;
             }
-            else
+            // fall through
+        case SQL_OP_IN:
+            if (!value.IsArray())
             {
-                Append(relation).Append(field).Append(" is not NULL");
+                return false;
             }
-            continue;
-        }
-
-        // sub-select query in where
-        if (it->value.IsObject())
-        {
-            Append(relation).Append(field).Append(" ");
-            SQL_ASSERT(PutWord(op, it->name.GetStringLength()));
-            Append(" ");
-            Append("(");
-            SQL_ASSERT(Select(it->value));
-            Append(")");
-            continue;
-        }
-
-        // normal comparision
-        if (0 == strcmp(op, "eq"))
-        {
-            Append(relation).Append(field).Append('=');
-        }
-        else if (0 == strcmp(op, "gt"))
-        {
-            Append(relation).Append(field).Append('>');
-        }
-        else if (0 == strcmp(op, "lt"))
-        {
-            Append(relation).Append(field).Append('<');
-        }
-        else if (0 == strcmp(op, "ne"))
-        {
-            Append(relation).Append(field).Append("!=");
-        }
-        else if (0 == strcmp(op, "ge"))
-        {
-            Append(relation).Append(field).Append(">=");
+            // fall through
+        case SQL_OP_EQ:
+        case SQL_OP_NE:
+        case SQL_OP_GT:
+        case SQL_OP_LT:
+        case SQL_OP_GE:
+        case SQL_OP_LE:
+            Relation(relation, first);
+            SQL_ASSERT(PutWord(field));
+            Append(s_sqlOpName[op].sql);
+            SQL_ASSERT(PutValue(value));
+            break;
+        case SQL_OP_REGEXP:
+            Relation(relation, first);
+            SQL_ASSERT(PutWord(field));
+            Append(IsPostgres() ? " ~ " : s_sqlOpName[op].sql);
+            SQL_ASSERT(PutValue(value));
+            break;
+        default:
+            break;
         }
-        else if (0 == strcmp(op, "le"))
-        {
-            Append(relation).Append(field).Append("<=");
-        }
-        else if (0 == strcmp(op, "not in") && it->value.IsArray() && it->value.Size() > 0)
-        {
-            Append(relation).Append(field).Append(" not IN ");
-        }
-        else
-        {
-            continue;
-        }
-
-        SQL_ASSERT(PutValue(it->value));
     }
     return true;
 }
@@ -806,39 +1339,137 @@ bool CSqlBuildBuffer::PushLimit(const rapidjson::Value& json)
         return true;
     }
     Append(" LIMIT ");
+    const rapidjson::Value* offset = nullptr;
+    const rapidjson::Value* count = nullptr;
     if (json.IsUint() || json.IsUint64())
     {
-        return PutValue(json);
+        count = &json;
     }
     else if (json.IsArray() && json.Size() == 2)
     {
-        auto& offset = json[0];
-        auto& count = json[1];
-        if (offset.IsUint() || offset.IsUint64())
+        offset = &json[0];
+        count = &json[1];
+    }
+    else if (json.IsObject())
+    {
+        offset = &(json/"offset");
+        count = &(json/"count");
+    }
+    else
+    {
+        return false;
+    }
+
+    if (offset && !offset->IsUint() && !offset->IsUint64())
+    {
+        offset = nullptr;
+    }
+
+    if (IsPostgres())
+    {
+        SQL_ASSERT(PutValue(*count));
+        if (offset)
         {
-            PutValue(offset);
-            Append(',');
+            Append(" OFFSET ");
+            SQL_ASSERT(PutValue(*offset));
         }
-        return PutValue(count);
+        return true;
     }
-    else if (json.IsObject())
+
+    if (offset)
+    {
+        PutValue(*offset);
+        Append(',');
+    }
+    return PutValue(*count);
+}
+
+/** upsert clause after insert.
+ * @param replace: emulate replace for PostgreSQL if no "update".
+ * */
+bool CSqlBuildBuffer::PushUpsert(const rapidjson::Value& json, bool replace)
+{
+    auto& update = json/"update";
+    bool hasUpdate = !!update && update.IsObject();
+    if (!IsPostgres())
+    {
+        if (hasUpdate)
+        {
+            Append(" ON DUPLICATE KEY UPDATE ");
+            SQL_ASSERT(DoSetValue(update));
+        }
+        return true;
+    }
+
+    if (!hasUpdate && !replace)
+    {
+        return true;
+    }
+    Append(" ON CONFLICT (");
+    SQL_ASSERT(PutWord(json/"conflict"));
+    Append(") DO UPDATE SET ");
+    if (hasUpdate)
+    {
+        return DoSetValue(update);
+    }
+    return PushExcluded(json);
+}
+
+/** Generate: field1=EXCLUDED.field1, ... for all inserted fields */
+bool CSqlBuildBuffer::PushExcluded(const rapidjson::Value& json)
+{
+    auto& field = insert_field(json);
+    if (!!field)
     {
-        auto& offset = json/"offset";
-        auto& count = json/"count";
-        if (offset.IsUint() || offset.IsUint64())
+        if (!field.IsArray() || field.Empty())
+        {
+            return false;
+        }
+        for (auto it = field.Begin(); it != field.End(); ++it)
         {
-            PutValue(offset);
+            SQL_ASSERT(PutWord(*it));
+            Append("=EXCLUDED.");
+            SQL_ASSERT(PutWord(*it));
             Append(',');
         }
-        return PutValue(count);
+        PopEnd(',');
+        return true;
     }
-    return false;
+
+    auto& value = json/"value";
+    const rapidjson::Value* row = &value;
+    if (value.IsArray())
+    {
+        if (value.Empty())
+        {
+            return false;
+        }
+        row = &value[0];
+    }
+    if (!row->IsObject())
+    {
+        return false;
+    }
+
+    for (auto it = row->MemberBegin(); it != row->MemberEnd(); ++it)
+    {
+        if (it->value.IsNull())
+        {
+            continue;
+        }
+        SQL_ASSERT(PutWord(it->name));
+        Append("=EXCLUDED.");
+        SQL_ASSERT(PutWord(it->name));
+        Append(',');
+    }
+    PopEnd(',');
+    return true;
 }
 
 /* ------------------------------------------------------------ */
 // Section:
 
-bool CSqlBuildBuffer::DoInsert(const rapidjson::Value& json)
+bool CSqlBuildBuffer::DoInsert(const rapidjson::Value& json, bool replace)
 {
     auto& table = json/"table";
     auto& value = json/"value";
@@ -849,27 +1480,27 @@ bool CSqlBuildBuffer::DoInsert(const rapidjson::Value& json)
 
     SQL_ASSERT(PushTable(table));
 
-    auto& field = json/"field";
+    auto& field = insert_field(json);
     if (!!field)
     {
         SQL_ASSERT(PushSetValue(value, field));
     }
+    else if (value.IsObject() && IsPostgres())
+    {
+        // PostgreSQL not support INSERT ... SET
+        SQL_ASSERT(DoBatchValue(value));
+    }
     else
     {
         SQL_ASSERT(PushSetValue(value));
     }
 
-    auto& update = json/"update";
-    if (!!update && update.IsObject())
-    {
-        Append(" ON DUPLICATE KEY UPDATE ");
-        SQL_ASSERT(DoSetValue(update));
-    }
+    SQL_ASSERT(PushUpsert(json, replace));
 
     // need to select last auto increment id after insert
     if (json/"last_insert_id" | false)
     {
-        Append("; SELECT last_insert_id()");
+        Append(IsPostgres() ? "; SELECT lastval()" : "; SELECT last_insert_id()");
     }
 
     return true;
@@ -968,39 +1599,81 @@ bool CSqlBuildBuffer::Delete(const rapidjson::Value& json)
 /* ************************************************************ */
 // Section: public class interface
 
-bool CSqlBuilder::Insert(const rapidjson::Value& json, std::string& sql)
+bool CSqlBuilder::Insert(const rapidjson::Value& json, std::string& sql) const
+{
+    CSqlBuildBuffer obj(sql, &m_config);
+    return obj.Insert(json);
+}
+
+bool CSqlBuilder::Replace(const rapidjson::Value& json, std::string& sql) const
+{
+    CSqlBuildBuffer obj(sql, &m_config);
+    return obj.Replace(json);
+}
+
+bool CSqlBuilder::Update(const rapidjson::Value& json, std::string& sql) const
+{
+    CSqlBuildBuffer obj(sql, &m_config);
+    return obj.Update(json);
+}
+
+bool CSqlBuilder::Select(const rapidjson::Value& json, std::string& sql) const
+{
+    CSqlBuildBuffer obj(sql, &m_config);
+    return obj.Select(json);
+}
+
+bool CSqlBuilder::Count(const rapidjson::Value& json, std::string& sql) const
+{
+    CSqlBuildBuffer obj(sql, &m_config);
+    return obj.Count(json);
+}
+
+bool CSqlBuilder::Delete(const rapidjson::Value& json, std::string& sql) const
+{
+    CSqlBuildBuffer obj(sql, &m_config);
+    return obj.Delete(json);
+}
+
+bool CSqlBuilder::Insert(const rapidjson::Value& json, std::string& sql, sql_param_t& params) const
 {
     CSqlBuildBuffer obj(sql, &m_config);
+    obj.SetParams(&params);
     return obj.Insert(json);
 }
 
-bool CSqlBuilder::Replace(const rapidjson::Value& json, std::string& sql)
+bool CSqlBuilder::Replace(const rapidjson::Value& json, std::string& sql, sql_param_t& params) const
 {
     CSqlBuildBuffer obj(sql, &m_config);
+    obj.SetParams(&params);
     return obj.Replace(json);
 }
 
-bool CSqlBuilder::Update(const rapidjson::Value& json, std::string& sql)
+bool CSqlBuilder::Update(const rapidjson::Value& json, std::string& sql, sql_param_t& params) const
 {
     CSqlBuildBuffer obj(sql, &m_config);
+    obj.SetParams(&params);
     return obj.Update(json);
 }
 
-bool CSqlBuilder::Select(const rapidjson::Value& json, std::string& sql)
+bool CSqlBuilder::Select(const rapidjson::Value& json, std::string& sql, sql_param_t& params) const
 {
     CSqlBuildBuffer obj(sql, &m_config);
+    obj.SetParams(&params);
     return obj.Select(json);
 }
 
-bool CSqlBuilder::Count(const rapidjson::Value& json, std::string& sql)
+bool CSqlBuilder::Count(const rapidjson::Value& json, std::string& sql, sql_param_t& params) const
 {
     CSqlBuildBuffer obj(sql, &m_config);
+    obj.SetParams(&params);
     return obj.Count(json);
 }
 
-bool CSqlBuilder::Delete(const rapidjson::Value& json, std::string& sql)
+bool CSqlBuilder::Delete(const rapidjson::Value& json, std::string& sql, sql_param_t& params) const
 {
     CSqlBuildBuffer obj(sql, &m_config);
+    obj.SetParams(&params);
     return obj.Delete(json);
 }
 
@@ -1043,6 +1716,1288 @@ bool sql_delete(const rapidjson::Value& json, std::string& sql)
     return obj.Delete(json);
 }
 
+bool sql_insert(const rapidjson::Value& json, std::string& sql, const sql_config_t& config)
+{
+    CSqlBuildBuffer obj(sql, &config);
+    return obj.Insert(json);
+}
+
+bool sql_replace(const rapidjson::Value& json, std::string& sql, const sql_config_t& config)
+{
+    CSqlBuildBuffer obj(sql, &config);
+    return obj.Replace(json);
+}
+
+bool sql_update(const rapidjson::Value& json, std::string& sql, const sql_config_t& config)
+{
+    CSqlBuildBuffer obj(sql, &config);
+    return obj.Update(json);
+}
+
+bool sql_select(const rapidjson::Value& json, std::string& sql, const sql_config_t& config)
+{
+    CSqlBuildBuffer obj(sql, &config);
+    return obj.Select(json);
+}
+
+bool sql_count(const rapidjson::Value& json, std::string& sql, const sql_config_t& config)
+{
+    CSqlBuildBuffer obj(sql, &config);
+    return obj.Count(json);
+}
+
+bool sql_delete(const rapidjson::Value& json, std::string& sql, const sql_config_t& config)
+{
+    CSqlBuildBuffer obj(sql, &config);
+    return obj.Delete(json);
+}
+
+/* ************************************************************ */
+// Section: sql template cache
+
+/** walk json in document order, generate the shape key and collect the
+ * scalar leaf values.
+ * @details Object key is kept verbatim with length prefix, scalar is
+ * replaced by a type tag, and the string in `` quote is distinguished as
+ * raw sql. Array length is implied by the count of item.
+ * */
+static void sql_shape(const rapidjson::Value& json, std::string& key, std::vector<const rapidjson::Value*>& leaves)
+{
+    if (json.IsObject())
+    {
+        key.push_back('{');
+        for (auto it = json.MemberBegin(); it != json.MemberEnd(); ++it)
+        {
+            key.append(std::to_string(it->name.GetStringLength())).push_back(':');
+            key.append(it->name.GetString(), it->name.GetStringLength());
+            sql_shape(it->value, key, leaves);
+        }
+        key.push_back('}');
+        return;
+    }
+    else if (json.IsArray())
+    {
+        key.push_back('[');
+        for (auto it = json.Begin(); it != json.End(); ++it)
+        {
+            sql_shape(*it, key, leaves);
+        }
+        key.push_back(']');
+        return;
+    }
+
+    char tag = 'd';
+    if (json.IsNull())
+    {
+        tag = 'n';
+    }
+    else if (json.IsBool())
+    {
+        tag = 'b';
+    }
+    else if (json.IsString())
+    {
+        tag = (json.GetStringLength() > 0 && json.GetString()[0] == BACK_QUOTE) ? 'r' : 's';
+    }
+    else if (json.IsUint())
+    {
+        tag = 'u';
+    }
+    else if (json.IsInt())
+    {
+        tag = 'i';
+    }
+    else if (json.IsUint64())
+    {
+        tag = 'U';
+    }
+    else if (json.IsInt64())
+    {
+        tag = 'I';
+    }
+    key.push_back(tag);
+    leaves.push_back(&json);
+}
+
+/** pre-split sql with the value omitted.
+ * @details The leaf not bound to slot may still affect the sql text, such
+ * as table name or sort field, so a copy is saved to compare on hit.
+ * */
+struct sql_template_t
+{
+    struct slot_t
+    {
+        size_t pos;
+        short kind;
+        size_t leaf;
+    };
+
+    std::string text;
+    std::vector<slot_t> slots;
+    std::vector<size_t> fixedLeaf;
+    rapidjson::Document fixedValue;
+
+    bool Match(const std::vector<const rapidjson::Value*>& leaves) const
+    {
+        for (size_t i = 0; i < fixedLeaf.size(); ++i)
+        {
+            if (*leaves[fixedLeaf[i]] != fixedValue[static_cast<rapidjson::SizeType>(i)])
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+/** max templates with the same shape but different fixed leaf */
+const size_t SQL_TEMPLATE_VARIANT = 4;
+
+/** the implementation of CSqlTemplateCache */
+class CSqlTemplateStore
+{
+public:
+    typedef std::shared_ptr<const sql_template_t> TemplatePtr;
+    typedef std::vector<const rapidjson::Value*> LeafList;
+    typedef bool (CSqlBuildBuffer::*BuildMethod)(const rapidjson::Value&);
+
+    CSqlTemplateStore(size_t capacity, const sql_config_t& config)
+        : m_config(config), m_capacity(capacity > 0 ? capacity : 1)
+    {}
+
+    bool Build(char method, BuildMethod fn, const rapidjson::Value& json, std::string& sql);
+    sql_cache_stat_t Stat();
+    void Clear();
+
+private:
+    TemplatePtr Find(const std::string& key, const LeafList& leaves);
+    TemplatePtr Compile(BuildMethod fn, const rapidjson::Value& json, const LeafList& leaves);
+    TemplatePtr Save(const std::string& key, const TemplatePtr& tpl, const LeafList& leaves);
+    bool Render(const sql_template_t& tpl, const LeafList& leaves, std::string& sql);
+
+    typedef std::pair<std::string, std::vector<TemplatePtr>> Bucket;
+    typedef std::list<Bucket> LruList;
+
+    sql_config_t m_config;
+    size_t m_capacity;
+    std::mutex m_mutex;
+    LruList m_lru; // most recently used at front
+    std::unordered_map<std::string, LruList::iterator> m_index;
+    sql_cache_stat_t m_stat;
+};
+
+bool CSqlTemplateStore::Build(char method, BuildMethod fn, const rapidjson::Value& json, std::string& sql)
+{
+    std::string key(1, method);
+    LeafList leaves;
+    sql_shape(json, key, leaves);
+
+    TemplatePtr tpl = Find(key, leaves);
+    if (!tpl)
+    {
+        tpl = Compile(fn, json, leaves);
+        if (!tpl)
+        {
+            CSqlBuildBuffer obj(sql, &m_config);
+            return (obj.*fn)(json);
+        }
+        tpl = Save(key, tpl, leaves);
+    }
+
+    return Render(*tpl, leaves, sql);
+}
+
+CSqlTemplateStore::TemplatePtr CSqlTemplateStore::Find(const std::string& key, const LeafList& leaves)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_index.find(key);
+    if (it != m_index.end())
+    {
+        m_lru.splice(m_lru.begin(), m_lru, it->second);
+        for (auto& tpl : it->second->second)
+        {
+            if (tpl->Match(leaves))
+            {
+                ++m_stat.hit;
+                return tpl;
+            }
+        }
+    }
+    ++m_stat.miss;
+    return nullptr;
+}
+
+CSqlTemplateStore::TemplatePtr CSqlTemplateStore::Compile(BuildMethod fn, const rapidjson::Value& json, const LeafList& leaves)
+{
+    std::shared_ptr<sql_template_t> tpl = std::make_shared<sql_template_t>();
+    sql_param_t params;
+    std::vector<sql_slot_t> slots;
+    CSqlBuildBuffer obj(tpl->text, &m_config);
+    obj.SetParams(&params);
+    obj.SetSlots(&slots);
+    if (!(obj.*fn)(json))
+    {
+        return nullptr;
+    }
+
+    std::unordered_map<const rapidjson::Value*, size_t> leafIndex;
+    for (size_t i = 0; i < leaves.size(); ++i)
+    {
+        leafIndex[leaves[i]] = i;
+    }
+
+    std::vector<bool> bound(leaves.size(), false);
+    for (size_t i = 0; i < slots.size(); ++i)
+    {
+        auto it = leafIndex.find(params[i]);
+        if (it == leafIndex.end())
+        {
+            LOGF("sql template slot not bound to json leaf");
+            return nullptr;
+        }
+        tpl->slots.push_back({slots[i].pos, slots[i].kind, it->second});
+        bound[it->second] = true;
+    }
+
+    auto& allocator = tpl->fixedValue.GetAllocator();
+    tpl->fixedValue.SetArray();
+    for (size_t i = 0; i < leaves.size(); ++i)
+    {
+        if (!bound[i])
+        {
+            tpl->fixedLeaf.push_back(i);
+            tpl->fixedValue.PushBack(rapidjson::Value(*leaves[i], allocator), allocator);
+        }
+    }
+
+    return tpl;
+}
+
+// save the compiled template, unless another thread has saved a matched one
+// while compiling, then return that one.
+CSqlTemplateStore::TemplatePtr CSqlTemplateStore::Save(const std::string& key, const TemplatePtr& tpl, const LeafList& leaves)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_index.find(key);
+    if (it != m_index.end())
+    {
+        auto& variant = it->second->second;
+        for (auto& saved : variant)
+        {
+            if (saved->Match(leaves))
+            {
+                return saved;
+            }
+        }
+        if (variant.size() >= SQL_TEMPLATE_VARIANT)
+        {
+            variant.erase(variant.begin());
+            ++m_stat.evict;
+        }
+        variant.push_back(tpl);
+        return tpl;
+    }
+
+    m_lru.push_front(Bucket(key, std::vector<TemplatePtr>(1, tpl)));
+    m_index[key] = m_lru.begin();
+    if (m_lru.size() > m_capacity)
+    {
+        m_index.erase(m_lru.back().first);
+        m_lru.pop_back();
+        ++m_stat.evict;
+    }
+    return tpl;
+}
+
+bool CSqlTemplateStore::Render(const sql_template_t& tpl, const LeafList& leaves, std::string& sql)
+{
+    const std::string& text = tpl.text;
+    sql.reserve(sql.size() + text.size() + tpl.slots.size() * 8);
+
+    CSqlBuildBuffer obj(sql, &m_config);
+    size_t last = 0;
+    for (auto& slot : tpl.slots)
+    {
+        obj.Append(text.c_str() + last, slot.pos - last);
+        last = slot.pos;
+        const rapidjson::Value& json = *leaves[slot.leaf];
+        if (slot.kind == SQL_SLOT_LIKE)
+        {
+            SQL_ASSERT(obj.PutLike(json));
+        }
+        else
+        {
+            SQL_ASSERT(obj.PutValue(json));
+        }
+    }
+    obj.Append(text.c_str() + last, text.size() - last);
+    return true;
+}
+
+sql_cache_stat_t CSqlTemplateStore::Stat()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    sql_cache_stat_t stat = m_stat;
+    stat.size = m_lru.size();
+    return stat;
+}
+
+void CSqlTemplateStore::Clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_index.clear();
+    m_lru.clear();
+    m_stat = sql_cache_stat_t();
+}
+
+CSqlTemplateCache::CSqlTemplateCache(size_t capacity, const sql_config_t* pConfig)
+{
+    m_store.reset(new CSqlTemplateStore(capacity, pConfig ? *pConfig : *get_sql_config()));
+}
+
+CSqlTemplateCache::~CSqlTemplateCache()
+{
+}
+
+bool CSqlTemplateCache::Insert(const rapidjson::Value& json, std::string& sql)
+{
+    return m_store->Build('I', &CSqlBuildBuffer::Insert, json, sql);
+}
+
+bool CSqlTemplateCache::Replace(const rapidjson::Value& json, std::string& sql)
+{
+    return m_store->Build('R', &CSqlBuildBuffer::Replace, json, sql);
+}
+
+bool CSqlTemplateCache::Update(const rapidjson::Value& json, std::string& sql)
+{
+    return m_store->Build('U', &CSqlBuildBuffer::Update, json, sql);
+}
+
+bool CSqlTemplateCache::Select(const rapidjson::Value& json, std::string& sql)
+{
+    return m_store->Build('S', &CSqlBuildBuffer::Select, json, sql);
+}
+
+bool CSqlTemplateCache::Count(const rapidjson::Value& json, std::string& sql)
+{
+    return m_store->Build('C', &CSqlBuildBuffer::Count, json, sql);
+}
+
+bool CSqlTemplateCache::Delete(const rapidjson::Value& json, std::string& sql)
+{
+    return m_store->Build('D', &CSqlBuildBuffer::Delete, json, sql);
+}
+
+sql_cache_stat_t CSqlTemplateCache::Stat()
+{
+    return m_store->Stat();
+}
+
+void CSqlTemplateCache::Clear()
+{
+    m_store->Clear();
+}
+
+/* ************************************************************ */
+// Section: chunked batch insert
+
+/** resolve the value of each column from object row.
+ * @details Resolve column by the position of previous matched key first,
+ * and only search all columns when the key order differ from head.
+ * Missing column is left as nullptr in cell.
+ * */
+static void sql_resolve_row(const rapidjson::Value& row,
+        const std::vector<const rapidjson::Value*>& field, std::vector<const rapidjson::Value*>& cell)
+{
+    size_t columns = field.size();
+    cell.assign(columns, nullptr);
+    size_t pos = 0;
+    for (auto it = row.MemberBegin(); it != row.MemberEnd(); ++it)
+    {
+        size_t idx = columns;
+        if (pos < columns && *field[pos] == it->name)
+        {
+            idx = pos;
+        }
+        else
+        {
+            for (size_t i = 0; i < columns; ++i)
+            {
+                if (*field[i] == it->name)
+                {
+                    idx = i;
+                    break;
+                }
+            }
+        }
+        if (idx < columns)
+        {
+            cell[idx] = &it->value;
+            pos = idx + 1;
+        }
+    }
+}
+
+/** put one row of object in batch insert */
+static bool sql_batch_row(CSqlBuildBuffer& obj, const rapidjson::Value& row,
+        const std::vector<const rapidjson::Value*>& field, std::vector<const rapidjson::Value*>& cell)
+{
+    if (!row.IsObject())
+    {
+        return false;
+    }
+
+    sql_resolve_row(row, field, cell);
+    obj.Append('(');
+    for (auto val : cell)
+    {
+        if (val == nullptr)
+        {
+            obj.Append("null");
+        }
+        else
+        {
+            SQL_ASSERT(obj.PutValue(*val));
+        }
+        obj.Append(',');
+    }
+    obj.PopEnd(',');
+    obj.Append(')');
+    return true;
+}
+
+CSqlBatchInsert::CSqlBatchInsert(const rapidjson::Value& json, const sql_config_t* pConfig)
+    : m_config(pConfig ? *pConfig : *get_sql_config())
+{
+    m_error = !Prepare(json);
+}
+
+bool CSqlBatchInsert::Prepare(const rapidjson::Value& json)
+{
+    auto& table = json/"table";
+    auto& value = json/"value";
+    if (!table || !value.IsArray() || value.Empty())
+    {
+        return false;
+    }
+    m_value = &value;
+
+    CSqlBuildBuffer head(m_head, &m_config);
+    head.Append("INSERT INTO ");
+    SQL_ASSERT(head.PushTable(table));
+    head.Append(" (");
+
+    auto& field = insert_field(json);
+    if (!!field)
+    {
+        if (!field.IsArray())
+        {
+            return false;
+        }
+        SQL_ASSERT(head.PutWord(field));
+        m_columns = field.Size();
+    }
+    else
+    {
+        auto& first = value[0];
+        if (!first.IsObject())
+        {
+            return false;
+        }
+        for (auto it = first.MemberBegin(); it != first.MemberEnd(); ++it)
+        {
+            if (it->value.IsNull())
+            {
+                continue;
+            }
+            SQL_ASSERT(head.PutWord(it->name));
+            head.Append(',');
+            m_field.push_back(&it->name);
+        }
+        head.PopEnd(',');
+        m_columns = m_field.size();
+    }
+    if (m_columns == 0)
+    {
+        return false;
+    }
+    head.Append(") VALUES ");
+
+    CSqlBuildBuffer tail(m_tail, &m_config);
+    SQL_ASSERT(tail.PushUpsert(json));
+
+    return true;
+}
+
+/** put rows from next to end, or until exceed the limit if required.
+ * @param next: the row to start and move forward.
+ * @param cell: buffer for resolved columns, one for each thread.
+ * @return false if meet invalid row.
+ * */
+bool CSqlBatchInsert::PutRows(std::string& sql, size_t& next, size_t end,
+        std::vector<const rapidjson::Value*>& cell, bool limit) const
+{
+    CSqlBuildBuffer obj(sql, &m_config);
+    size_t rows = 0;
+    while (next < end && (!limit || m_maxRows == 0 || rows < m_maxRows))
+    {
+        size_t last = sql.size();
+        if (rows > 0)
+        {
+            obj.Append(", ");
+        }
+
+        auto& row = (*m_value)[static_cast<rapidjson::SizeType>(next)];
+        bool ok = false;
+        if (m_field.empty())
+        {
+            ok = row.IsArray() && row.Size() == m_columns && obj.PutValue(row);
+        }
+        else
+        {
+            ok = sql_batch_row(obj, row, m_field, cell);
+        }
+        if (!ok)
+        {
+            LOGF("invalid row %zu in batch insert", next);
+            return false;
+        }
+
+        // the row exceed limit is left to next statement
+        if (limit && m_maxBytes > 0 && rows > 0 && sql.size() + m_tail.size() > m_maxBytes)
+        {
+            sql.resize(last);
+            break;
+        }
+        ++rows;
+        ++next;
+    }
+    return true;
+}
+
+bool CSqlBatchInsert::Next(std::string& sql)
+{
+    sql.clear();
+    if (m_error || m_next >= RowCount())
+    {
+        return false;
+    }
+
+    sql.append(m_head);
+    if (!PutRows(sql, m_next, RowCount(), m_cell, true))
+    {
+        m_error = true;
+        sql.clear();
+        return false;
+    }
+    sql.append(m_tail);
+    return true;
+}
+
+/** split the rest rows to ranges for each worker thread.
+ * @details The range is aligned to MaxRows, so the statements are the same
+ * as generated by Next() one by one, if only limited by row count.
+ * */
+std::vector<size_t> CSqlBatchInsert::SplitRange(int threads) const
+{
+    size_t total = RowCount();
+    size_t rest = total - m_next;
+    if (threads <= 0)
+    {
+        threads = std::thread::hardware_concurrency();
+    }
+    size_t workers = (rest + SQL_PARALLEL_MIN_ROWS - 1) / SQL_PARALLEL_MIN_ROWS;
+    if (workers > static_cast<size_t>(threads))
+    {
+        workers = threads;
+    }
+    if (workers == 0)
+    {
+        workers = 1;
+    }
+
+    size_t step = (rest + workers - 1) / workers;
+    if (m_maxRows > 0)
+    {
+        step = (step + m_maxRows - 1) / m_maxRows * m_maxRows;
+    }
+
+    std::vector<size_t> range;
+    for (size_t begin = m_next; begin < total; begin += step)
+    {
+        range.push_back(begin);
+    }
+    range.push_back(total);
+    return range;
+}
+
+bool CSqlBatchInsert::Parallel(std::vector<std::string>& sqls, int threads)
+{
+    if (m_error || m_next >= RowCount())
+    {
+        return false;
+    }
+
+    std::vector<size_t> range = SplitRange(threads);
+    size_t workers = range.size() - 1;
+    std::vector<std::vector<std::string>> output(workers);
+    std::vector<char> result(workers, 0);
+    auto work = [this, &range, &output, &result](size_t idx) {
+        std::vector<const rapidjson::Value*> cell;
+        size_t next = range[idx];
+        while (next < range[idx+1])
+        {
+            output[idx].push_back(m_head);
+            std::string& sql = output[idx].back();
+            if (!PutRows(sql, next, range[idx+1], cell, true))
+            {
+                return;
+            }
+            sql.append(m_tail);
+        }
+        result[idx] = 1;
+    };
+
+    std::vector<std::thread> pool;
+    for (size_t i = 1; i < workers; ++i)
+    {
+        pool.emplace_back(work, i);
+    }
+    work(0);
+    for (auto& th : pool)
+    {
+        th.join();
+    }
+
+    for (size_t i = 0; i < workers; ++i)
+    {
+        if (!result[i])
+        {
+            m_error = true;
+            return false;
+        }
+    }
+    for (auto& part : output)
+    {
+        for (auto& sql : part)
+        {
+            sqls.push_back(std::move(sql));
+        }
+    }
+    m_next = RowCount();
+    return true;
+}
+
+bool CSqlBatchInsert::Parallel(std::string& sql, int threads)
+{
+    if (m_error || m_next >= RowCount())
+    {
+        return false;
+    }
+
+    std::vector<size_t> range = SplitRange(threads);
+    size_t workers = range.size() - 1;
+    std::vector<std::string> output(workers);
+    std::vector<char> result(workers, 0);
+    auto work = [this, &range, &output, &result](size_t idx) {
+        std::vector<const rapidjson::Value*> cell;
+        size_t next = range[idx];
+        result[idx] = PutRows(output[idx], next, range[idx+1], cell, false);
+    };
+
+    std::vector<std::thread> pool;
+    for (size_t i = 1; i < workers; ++i)
+    {
+        pool.emplace_back(work, i);
+    }
+    work(0);
+    for (auto& th : pool)
+    {
+        th.join();
+    }
+
+    size_t size = m_head.size() + m_tail.size();
+    for (size_t i = 0; i < workers; ++i)
+    {
+        if (!result[i])
+        {
+            m_error = true;
+            return false;
+        }
+        size += output[i].size() + 2;
+    }
+
+    sql.reserve(sql.size() + size);
+    sql.append(m_head);
+    for (size_t i = 0; i < workers; ++i)
+    {
+        if (i > 0)
+        {
+            sql.append(", ");
+        }
+        sql.append(output[i]);
+    }
+    sql.append(m_tail);
+    m_next = RowCount();
+    return true;
+}
+
+/** max statements built ahead of the sink in CSqlBatchInsert::Run() */
+const size_t SQL_BATCH_QUEUE = 2;
+
+int CSqlBatchInsert::Run(sql_sink_t sink)
+{
+    // statements built by the worker, with the first row of each
+    std::deque<std::pair<size_t, std::string>> queue;
+    std::mutex mutex;
+    std::condition_variable cond;
+    bool done = false;
+    bool stop = false;
+
+    // one worker build all statements, and wait when the queue is full
+    std::thread worker([&]() {
+        while (true)
+        {
+            size_t start = m_next;
+            std::string sql;
+            bool more = Next(sql);
+
+            std::unique_lock<std::mutex> lock(mutex);
+            cond.wait(lock, [&]() { return stop || queue.size() < SQL_BATCH_QUEUE; });
+            if (stop || !more)
+            {
+                done = true;
+                cond.notify_all();
+                break;
+            }
+            queue.emplace_back(start, std::move(sql));
+            cond.notify_all();
+        }
+    });
+
+    int count = 0;
+    size_t refused = 0;
+    bool rollback = false;
+    while (true)
+    {
+        std::pair<size_t, std::string> item;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cond.wait(lock, [&]() { return done || !queue.empty(); });
+            if (queue.empty())
+            {
+                break;
+            }
+            item = std::move(queue.front());
+            queue.pop_front();
+            cond.notify_all();
+        }
+
+        if (!sink(item.second))
+        {
+            refused = item.first;
+            rollback = true;
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+            cond.notify_all();
+            break;
+        }
+        ++count;
+    }
+
+    worker.join();
+    if (rollback)
+    {
+        // the rows of refused statement and those built ahead are not done
+        m_next = refused;
+    }
+    return count;
+}
+
+/* ************************************************************ */
+// Section: bulk load export
+
+/** char need escape in text format of COPY */
+const unsigned char BULK_TEXT = 1;
+/** char need quote in csv format of COPY */
+const unsigned char BULK_CSV = 2;
+/** char need escape in tsv format of LOAD DATA */
+const unsigned char BULK_TSV = 4;
+
+struct bulk_table_t
+{
+    unsigned char flag[256];
+    bulk_table_t()
+    {
+        memset(flag, 0, sizeof(flag));
+        flag[(unsigned char)'\\'] = BULK_TEXT | BULK_TSV;
+        flag[(unsigned char)'\t'] = BULK_TEXT | BULK_TSV;
+        flag[(unsigned char)'\n'] = BULK_TEXT | BULK_CSV | BULK_TSV;
+        flag[(unsigned char)'\r'] = BULK_TEXT | BULK_CSV | BULK_TSV;
+        flag[(unsigned char)'\0'] = BULK_TSV;
+        flag[(unsigned char)','] = BULK_CSV;
+        flag[(unsigned char)'"'] = BULK_CSV;
+    }
+};
+static const bulk_table_t s_bulkTable;
+
+static unsigned char bulk_kind(short format)
+{
+    if (format == SQL_BULK_COPY_CSV)
+    {
+        return BULK_CSV;
+    }
+    return format == SQL_BULK_LOAD_DATA ? BULK_TSV : BULK_TEXT;
+}
+
+/** write string field in bulk data, copy clean run in bulk */
+static void bulk_escape(std::string& data, const char* psz, size_t count, short format)
+{
+    unsigned char kind = bulk_kind(format);
+    size_t i = 0;
+    while (i < count && !(s_bulkTable.flag[(unsigned char)psz[i]] & kind))
+    {
+        ++i;
+    }
+
+    if (kind == BULK_CSV)
+    {
+        // empty string is quoted to distinguish from null, and \. alone
+        // is the end of data marker
+        bool marker = (count == 2 && psz[0] == '\\' && psz[1] == '.');
+        if (i == count && count > 0 && !marker)
+        {
+            data.append(psz, count);
+            return;
+        }
+        data.push_back('"');
+        for (size_t k = 0; k < count; ++k)
+        {
+            if (psz[k] == '"')
+            {
+                data.push_back('"');
+            }
+            data.push_back(psz[k]);
+        }
+        data.push_back('"');
+        return;
+    }
+
+    size_t last = 0;
+    for (; i < count; ++i)
+    {
+        char ch = psz[i];
+        if (!(s_bulkTable.flag[(unsigned char)ch] & kind))
+        {
+            continue;
+        }
+        data.append(psz + last, i - last);
+        data.push_back('\\');
+        switch (ch)
+        {
+        case '\t': data.push_back('t'); break;
+        case '\n': data.push_back('n'); break;
+        case '\r': data.push_back('r'); break;
+        case '\0': data.push_back('0'); break;
+        default: data.push_back(ch); break;
+        }
+        last = i + 1;
+    }
+    data.append(psz + last, count - last);
+}
+
+static void bulk_null(std::string& data, short format)
+{
+    if (format != SQL_BULK_COPY_CSV)
+    {
+        data.append("\\N");
+    }
+}
+
+static bool bulk_value(std::string& data, const rapidjson::Value* json, short format)
+{
+    if (json == nullptr || json->IsNull())
+    {
+        bulk_null(data, format);
+    }
+    else if (json->IsBool())
+    {
+        if (format == SQL_BULK_LOAD_DATA)
+        {
+            data.push_back(json->GetBool() ? '1' : '0');
+        }
+        else
+        {
+            data.append(json->GetBool() ? "true" : "false");
+        }
+    }
+    else if (json->IsNumber())
+    {
+        char buffer[32];
+        size_t len = format_number(*json, buffer);
+        if (len == 0)
+        {
+            return false;
+        }
+        data.append(buffer, len);
+    }
+    else if (json->IsString())
+    {
+        const char* psz = json->GetString();
+        size_t count = json->GetStringLength();
+        if (count > 0 && psz[0] == BACK_QUOTE)
+        {
+            if (count == 6 && 0 == strncmp(psz, "`null`", 6))
+            {
+                bulk_null(data, format);
+                return true;
+            }
+            LOGF("raw sql not supported in bulk data: %s", psz);
+            return false;
+        }
+        bulk_escape(data, psz, count, format);
+    }
+    else
+    {
+        std::string text = stringfy(*json);
+        bulk_escape(data, text.c_str(), text.size(), format);
+    }
+    return true;
+}
+
+CSqlBulkExport::CSqlBulkExport(const rapidjson::Value& json, short format)
+    : m_format(format)
+{
+    m_error = !Prepare(json);
+}
+
+bool CSqlBulkExport::Prepare(const rapidjson::Value& json)
+{
+    auto& table = json/"table";
+    auto& value = json/"value";
+    if (!table || !value.IsArray() || value.Empty())
+    {
+        return false;
+    }
+    m_value = &value;
+
+    CSqlBuildBuffer head(m_head);
+    SQL_ASSERT(head.PushTable(table));
+    head.Append(" (");
+
+    auto& field = insert_field(json);
+    if (!!field)
+    {
+        if (!field.IsArray())
+        {
+            return false;
+        }
+        SQL_ASSERT(head.PutWord(field));
+        m_columns = field.Size();
+    }
+    else
+    {
+        auto& first = value[0];
+        if (!first.IsObject())
+        {
+            return false;
+        }
+        for (auto it = first.MemberBegin(); it != first.MemberEnd(); ++it)
+        {
+            if (it->value.IsNull())
+            {
+                continue;
+            }
+            SQL_ASSERT(head.PutWord(it->name));
+            head.Append(',');
+            m_field.push_back(&it->name);
+        }
+        head.PopEnd(',');
+        m_columns = m_field.size();
+    }
+    head.Append(')');
+
+    return m_columns > 0;
+}
+
+bool CSqlBulkExport::Command(std::string& sql, const char* file) const
+{
+    if (m_error)
+    {
+        return false;
+    }
+
+    CSqlBuildBuffer obj(sql);
+    if (m_format == SQL_BULK_LOAD_DATA)
+    {
+        if (file == nullptr)
+        {
+            file = "/dev/stdin";
+        }
+        obj.Append("LOAD DATA LOCAL INFILE '");
+        obj.PutEscape(file, strlen(file));
+        obj.Append("' INTO TABLE ").Append(m_head);
+        return true;
+    }
+
+    obj.Append("COPY ").Append(m_head).Append(" FROM STDIN");
+    if (m_format == SQL_BULK_COPY_CSV)
+    {
+        obj.Append(" WITH (FORMAT csv)");
+    }
+    return true;
+}
+
+bool CSqlBulkExport::PutRow(std::string& data, const rapidjson::Value& row)
+{
+    char sep = (m_format == SQL_BULK_COPY_CSV) ? ',' : '\t';
+    if (m_field.empty())
+    {
+        if (!row.IsArray() || row.Size() != m_columns)
+        {
+            return false;
+        }
+        for (auto it = row.Begin(); it != row.End(); ++it)
+        {
+            if (it != row.Begin())
+            {
+                data.push_back(sep);
+            }
+            SQL_ASSERT(bulk_value(data, &(*it), m_format));
+        }
+    }
+    else
+    {
+        if (!row.IsObject())
+        {
+            return false;
+        }
+        sql_resolve_row(row, m_field, m_cell);
+        for (size_t i = 0; i < m_columns; ++i)
+        {
+            if (i > 0)
+            {
+                data.push_back(sep);
+            }
+            SQL_ASSERT(bulk_value(data, m_cell[i], m_format));
+        }
+    }
+    data.push_back('\n');
+    return true;
+}
+
+bool CSqlBulkExport::Write(std::string& data)
+{
+    if (m_error)
+    {
+        return false;
+    }
+
+    size_t total = RowCount();
+    for (; m_next < total; ++m_next)
+    {
+        if (!PutRow(data, (*m_value)[static_cast<rapidjson::SizeType>(m_next)]))
+        {
+            LOGF("invalid row %zu in bulk export", m_next);
+            m_error = true;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool CSqlBulkExport::Run(sql_sink_t sink, size_t chunkBytes)
+{
+    if (m_error)
+    {
+        return false;
+    }
+
+    std::string buffer;
+    buffer.reserve(chunkBytes + chunkBytes / 4);
+    size_t start = m_next;
+    size_t total = RowCount();
+    while (m_next < total)
+    {
+        if (!PutRow(buffer, (*m_value)[static_cast<rapidjson::SizeType>(m_next)]))
+        {
+            LOGF("invalid row %zu in bulk export", m_next);
+            m_error = true;
+            return false;
+        }
+        ++m_next;
+
+        if (buffer.size() >= chunkBytes || m_next == total)
+        {
+            if (!sink(buffer))
+            {
+                m_next = start;
+                return false;
+            }
+            buffer.clear();
+            start = m_next;
+        }
+    }
+    return true;
+}
+
+/* ************************************************************ */
+// Section: result set to json
+
+CSqlResultBuilder::CSqlResultBuilder(rapidjson::Document& doc, short shape)
+    : m_doc(doc), m_shape(shape)
+{
+    auto& allocator = m_doc.GetAllocator();
+    if (m_shape == SQL_RESULT_COLUMNAR)
+    {
+        m_doc.SetObject();
+        m_doc.AddMember("head", rapidjson::Value(rapidjson::kArrayType), allocator);
+        m_doc.AddMember("value", rapidjson::Value(rapidjson::kArrayType), allocator);
+        m_rows = &m_doc["value"];
+    }
+    else
+    {
+        m_doc.SetArray();
+        m_rows = &m_doc;
+    }
+}
+
+bool CSqlResultBuilder::AddColumn(const char* name, short type)
+{
+    if (name == nullptr || !m_rows->Empty())
+    {
+        return false;
+    }
+
+    // intern the key in document allocator, shared by each row as const string
+    auto& allocator = m_doc.GetAllocator();
+    size_t len = strlen(name);
+    char* copy = static_cast<char*>(allocator.Malloc(len + 1));
+    memcpy(copy, name, len + 1);
+    m_keys.push_back(rapidjson::Value(rapidjson::StringRef(copy, len)));
+    m_types.push_back(type);
+
+    if (m_shape == SQL_RESULT_COLUMNAR)
+    {
+        m_doc["head"].PushBack(rapidjson::Value(rapidjson::StringRef(copy, len)), allocator);
+    }
+    return true;
+}
+
+void CSqlResultBuilder::Reserve(size_t rows)
+{
+    m_rows->Reserve(static_cast<rapidjson::SizeType>(rows), m_doc.GetAllocator());
+}
+
+void CSqlResultBuilder::PutCell(rapidjson::Value& dest, const char* text, size_t len, short type)
+{
+    auto& allocator = m_doc.GetAllocator();
+    if (text == nullptr)
+    {
+        dest.SetNull();
+        return;
+    }
+
+    if (len > 0 && len < 64 && type != SQL_COLUMN_STRING)
+    {
+        // cell text may not be null terminated
+        char buffer[64];
+        memcpy(buffer, text, len);
+        buffer[len] = '\0';
+        char* end = nullptr;
+        if (type == SQL_COLUMN_INT)
+        {
+            errno = 0;
+            long long value = strtoll(buffer, &end, 10);
+            if (end == buffer + len && errno != ERANGE)
+            {
+                dest.SetInt64(value);
+                return;
+            }
+        }
+        else if (type == SQL_COLUMN_DOUBLE)
+        {
+            // not accept nan, inf or hex float that json can not write
+            double value = strtod(buffer, &end);
+            if (end == buffer + len && std::isfinite(value) && strpbrk(buffer, "xX") == nullptr)
+            {
+                dest.SetDouble(value);
+                return;
+            }
+        }
+        else if (type == SQL_COLUMN_BOOL)
+        {
+            if (0 == strcmp(buffer, "1") || 0 == strcmp(buffer, "t") || 0 == strcmp(buffer, "true"))
+            {
+                dest.SetBool(true);
+                return;
+            }
+            if (0 == strcmp(buffer, "0") || 0 == strcmp(buffer, "f") || 0 == strcmp(buffer, "false"))
+            {
+                dest.SetBool(false);
+                return;
+            }
+        }
+    }
+
+    dest.SetString(text, static_cast<rapidjson::SizeType>(len), allocator);
+}
+
+bool CSqlResultBuilder::AddRow(const sql_cell_fn& cell)
+{
+    if (m_keys.empty())
+    {
+        return false;
+    }
+
+    auto& allocator = m_doc.GetAllocator();
+    size_t columns = m_keys.size();
+    if (m_shape == SQL_RESULT_COLUMNAR)
+    {
+        rapidjson::Value row(rapidjson::kArrayType);
+        row.Reserve(static_cast<rapidjson::SizeType>(columns), allocator);
+        for (size_t i = 0; i < columns; ++i)
+        {
+            size_t len = 0;
+            const char* text = cell(i, len);
+            rapidjson::Value value;
+            PutCell(value, text, len, m_types[i]);
+            row.PushBack(value, allocator);
+        }
+        m_rows->PushBack(row, allocator);
+    }
+    else
+    {
+        rapidjson::Value row(rapidjson::kObjectType);
+        row.MemberReserve(static_cast<rapidjson::SizeType>(columns), allocator);
+        for (size_t i = 0; i < columns; ++i)
+        {
+            size_t len = 0;
+            const char* text = cell(i, len);
+            rapidjson::Value value;
+            PutCell(value, text, len, m_types[i]);
+            rapidjson::Value key(rapidjson::StringRef(m_keys[i].GetString(), m_keys[i].GetStringLength()));
+            row.AddMember(key, value, allocator);
+        }
+        m_rows->PushBack(row, allocator);
+    }
+    return true;
+}
+
+bool CSqlResultBuilder::AddRow(const char* const* values, const size_t* lengths)
+{
+    if (values == nullptr)
+    {
+        return false;
+    }
+    return AddRow([values, lengths](size_t col, size_t& len) {
+        const char* text = values[col];
+        len = lengths ? lengths[col] : (text ? strlen(text) : 0);
+        return text;
+    });
+}
+
 /* ************************************************************ */
 
 } /* jsonkit */ 
@@ -8,6 +8,11 @@
 #ifndef JSON_SQLBUILDER_H__
 #define JSON_SQLBUILDER_H__
 
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
 #include "rapidjson/document.h"
 
 namespace jsonkit
@@ -18,6 +23,16 @@ const short SQL_LIKE_POSTFIX = 1;
 /** add '%' prefix in like statement */
 const short SQL_LIKE_PREFIX = 2;
 
+/** placeholder `?` for value in prepared statement */
+const short SQL_PLACEHOLDER_QUESTION = 0;
+/** placeholder `$1`, `$2`, ... for value in prepared statement */
+const short SQL_PLACEHOLDER_DOLLAR = 1;
+
+/** sql dialect for MySQL, the default */
+const short SQL_DIALECT_MYSQL = 0;
+/** sql dialect for PostgreSQL */
+const short SQL_DIALECT_POSTGRES = 1;
+
 /** config some behavior of sql generation */
 struct sql_config_t
 {
@@ -33,13 +48,67 @@ struct sql_config_t
 
     /** not generate update sql if without where clause */
     bool refuse_update_without_where = true;
+
+    /** placeholder style in prepared statement, SQL_PLACEHOLDER_QUESTION
+     * or SQL_PLACEHOLDER_DOLLAR */
+    short placeholder = SQL_PLACEHOLDER_QUESTION;
+
+    /** also escape backslash as \\ in quoted string, besides quote as ''.
+     * @details Only enable it for MySQL server that treat backslash as
+     * escape char in string literal, i.e. not in NO_BACKSLASH_ESCAPES mode,
+     * otherwise the backslash is doubled in saved data. Standard SQL, and
+     * PostgreSQL with standard_conforming_strings, should not enable it.
+     * */
+    bool escape_backslash = false;
+
+    /** the target database, SQL_DIALECT_MYSQL or SQL_DIALECT_POSTGRES.
+     * @details The dialect is checked once for each clause that differ:
+     * - limit: MySQL `LIMIT offset,count`, PostgreSQL `LIMIT count OFFSET offset`;
+     * - upsert: MySQL `ON DUPLICATE KEY UPDATE`, PostgreSQL
+     *   `ON CONFLICT (...) DO UPDATE SET` with the keys in "conflict";
+     * - replace: PostgreSQL has no `REPLACE INTO`, emulate by upsert all
+     *   inserted fields as `field=EXCLUDED.field`, also need "conflict";
+     * - last_insert_id: PostgreSQL select `lastval()` instead.
+     * The identifier such as table and field name is never quoted in any
+     * dialect, only rejected if contains quote, back quote or `;`. Name
+     * that is reserved word or case sensitive should be quoted by caller,
+     * `"name"` for PostgreSQL, as back quote is input syntax for raw sql.
+     * */
+    short dialect = SQL_DIALECT_MYSQL;
 };
 
+/** get the recommended config for some dialect.
+ * @details Besides the dialect, PostgreSQL use `$n` placeholder.
+ * */
+sql_config_t sql_dialect_config(short dialect);
+
+/** parameter list for prepared statement.
+ * @details Each item point to the json value bound to the placeholder in
+ * the same order, the json type is the parameter type. The string is not
+ * copied, so the list is only valid while the input json is alive.
+ * */
+typedef std::vector<const rapidjson::Value*> sql_param_t;
+
+/** callback to consume generated sql, return false to stop generation */
+typedef std::function<bool(const std::string& sql)> sql_sink_t;
+
+/** immutable config that can be shared by multiply threads */
+typedef std::shared_ptr<const sql_config_t> sql_config_ptr;
+
+/** get the snapshot of internal default config used by sql_xxx() */
+sql_config_ptr get_sql_config();
+
 /** set the internal static sql generation config.
  * @param cfg: pointer for sql config struct, can be nullptr to only get.
  * @return the original config.
- * @note not thread safe, better only change config on init stage if really
- * need some value different from default. 
+ * @note The default config is replaced atomically as a whole, the sql
+ * being generated in other thread still use the old one. But it is still
+ * process wide, use the overload with config argument, or CSqlBuilder
+ * object, for different config at the same time.
+ * Each thread caches the snapshot of default config with a version, so
+ * sql_xxx() only pay an atomic integer load, and reload the snapshot once
+ * after it is replaced, while get_sql_config() itself may lock inside
+ * std::atomic_load() of shared_ptr.
  * @code
  * jsonkit::sql_config_t cfg = jsonkit::set_sql_config(nullptr);
  * cfg.fix_like_value = jsonkit::SQL_LIKE_POSTFIX | jsonkit::SQL_LIKE_PREFIX;
@@ -67,6 +136,7 @@ sql_config_t set_sql_config(const sql_config_t* cfg);
  * { "table": "t_name", "value": {"f_1":"v_1", "f_2":"v_2"} }
  * { "table": "t_name", "value": [{},{}] } // value is array of object
  * { "table": "t_name", "head": ["f1","f2"], "value": [["v1","V2"],[1,2]] }
+ * "field" is the same as "head" for array of array value.
  * */
 bool sql_insert(const rapidjson::Value& json, std::string& sql);
 
@@ -103,13 +173,97 @@ bool sql_count(const rapidjson::Value& json, std::string& sql);
  * */
 bool sql_delete(const rapidjson::Value& json, std::string& sql);
 
+/** the same as above but use the specified config, not the default one */
+bool sql_insert(const rapidjson::Value& json, std::string& sql, const sql_config_t& config);
+bool sql_replace(const rapidjson::Value& json, std::string& sql, const sql_config_t& config);
+bool sql_update(const rapidjson::Value& json, std::string& sql, const sql_config_t& config);
+bool sql_select(const rapidjson::Value& json, std::string& sql, const sql_config_t& config);
+bool sql_count(const rapidjson::Value& json, std::string& sql, const sql_config_t& config);
+bool sql_delete(const rapidjson::Value& json, std::string& sql, const sql_config_t& config);
+
 /** class interface for SQL builder.
  * @details A CSqlbuilder object can keep individual config to custome some
  * behavior for later sql generation. Then each method is the same use as the
  * free function sql_xxx();
+ * The methods are const, so a builder can be shared by multiply threads
+ * as long as the config is not changed.
  * */
 struct CSqlBuilder
 {
+    CSqlBuilder() {}
+    explicit CSqlBuilder(const sql_config_t& config) : m_config(config) {}
+
+    bool Insert(const rapidjson::Value& json, std::string& sql) const;
+    bool Replace(const rapidjson::Value& json, std::string& sql) const;
+    bool Update(const rapidjson::Value& json, std::string& sql) const;
+    bool Select(const rapidjson::Value& json, std::string& sql) const;
+    bool Count(const rapidjson::Value& json, std::string& sql) const;
+    bool Delete(const rapidjson::Value& json, std::string& sql) const;
+
+    /** prepared statement mode.
+     * @details Generate the same as above, but each value is replaced by a
+     * placeholder in sql, and the json value is appended to `params`. Then
+     * json with the same shape generate the same sql text, which can be
+     * prepared once and executed many times with different params.
+     * Value not bound to placeholder:
+     * - null value, still generate `null` or skipped as before;
+     * - string in `` quote, which is raw sql expression such as `now()`;
+     * - like pattern when `escape_like_metachar` is configured, as it
+     *   should be modified, otherwise the '%' is concatenated in sql by
+     *   CONCAT() function, or by `||` operator for PostgreSQL.
+     * */
+    bool Insert(const rapidjson::Value& json, std::string& sql, sql_param_t& params) const;
+    bool Replace(const rapidjson::Value& json, std::string& sql, sql_param_t& params) const;
+    bool Update(const rapidjson::Value& json, std::string& sql, sql_param_t& params) const;
+    bool Select(const rapidjson::Value& json, std::string& sql, sql_param_t& params) const;
+    bool Count(const rapidjson::Value& json, std::string& sql, sql_param_t& params) const;
+    bool Delete(const rapidjson::Value& json, std::string& sql, sql_param_t& params) const;
+
+    sql_config_t& Config() { return m_config; }
+    const sql_config_t& Config() const { return m_config; }
+    sql_config_t m_config;
+};
+
+/** statistics of CSqlTemplateCache */
+struct sql_cache_stat_t
+{
+    size_t hit = 0;
+    size_t miss = 0;
+    size_t evict = 0;
+    size_t size = 0;
+
+    double HitRate() const
+    {
+        size_t total = hit + miss;
+        return total > 0 ? double(hit) / total : 0.0;
+    }
+};
+
+class CSqlTemplateStore;
+
+/** Sql builder that cache template by the shape of json query.
+ * @details The shape of json is the object keys, array length and scalar
+ * type in document order. The first query of some shape is compiled to a
+ * sql template with the value omitted, and the later query of the same
+ * shape only insert the escaped value to the known slot, not walk the
+ * where operators again.
+ * The scalar not bound to value slot, such as table name, is compared on
+ * hit, so query of the same shape but different table still get correct
+ * sql, and a few such variants are cached under the same shape.
+ * The cache is bounded by the number of shapes in LRU order, and is safe
+ * to be shared by multiply threads.
+ * @note The config is copied on construction and can not change later,
+ * as the cached template depend on it.
+ * */
+class CSqlTemplateCache
+{
+public:
+    explicit CSqlTemplateCache(size_t capacity = 1024, const sql_config_t* pConfig = nullptr);
+    ~CSqlTemplateCache();
+
+    CSqlTemplateCache(const CSqlTemplateCache& that) = delete;
+    CSqlTemplateCache& operator=(const CSqlTemplateCache& that) = delete;
+
     bool Insert(const rapidjson::Value& json, std::string& sql);
     bool Replace(const rapidjson::Value& json, std::string& sql);
     bool Update(const rapidjson::Value& json, std::string& sql);
@@ -117,8 +271,215 @@ struct CSqlBuilder
     bool Count(const rapidjson::Value& json, std::string& sql);
     bool Delete(const rapidjson::Value& json, std::string& sql);
 
-    sql_config_t& Config() { return m_config; }
+    /** get the hit and miss count, and number of cached shapes */
+    sql_cache_stat_t Stat();
+    void Clear();
+
+private:
+    std::unique_ptr<CSqlTemplateStore> m_store;
+};
+
+/** min rows for each thread in CSqlBatchInsert::Parallel() */
+const size_t SQL_PARALLEL_MIN_ROWS = 1000;
+
+/** Generate batch insert sql in chunks limited by row count or byte size.
+ * @details The input json is the same as sql_insert() with array value,
+ * either array of object with the columns from the first row, or array of
+ * array with the columns from "field". Each call of Next() generate one
+ * `INSERT ... VALUES (...), (...)` statement until all rows consumed.
+ * The head of sql is built once, and the column of each object row is
+ * resolved by it's position first, only search when the key order differ.
+ * Missing column in object row is filled with null.
+ * @code
+ * CSqlBatchInsert batch(json);
+ * batch.MaxRows(1000).MaxBytes(4 << 20);
+ * std::string sql;
+ * while (batch.Next(sql)) { execute(sql); }
+ * if (batch.Error()) { ... }
+ * @endcode
+ * @note The input json should keep alive and unchanged while generating.
+ * */
+class CSqlBatchInsert
+{
+public:
+    CSqlBatchInsert(const rapidjson::Value& json, const sql_config_t* pConfig = nullptr);
+
+    /** max rows in one statement, 0 for no limit, default 1000 */
+    CSqlBatchInsert& MaxRows(size_t rows) { m_maxRows = rows; return *this; }
+    /** max bytes of one statement, 0 for no limit.
+     * A single row longer than the limit is still put in one statement. */
+    CSqlBatchInsert& MaxBytes(size_t bytes) { m_maxBytes = bytes; return *this; }
+
+    /** generate the next statement, overwrite the output sql.
+     * @return false if all rows done or on error. */
+    bool Next(std::string& sql);
+
+    /** generate all statements and pass to sink.
+     * @details One worker thread builds the statements ahead into a small
+     * bounded queue, while the sink is always called in the current thread
+     * that call Run(), one at a time in order, so the sink can use a
+     * database connection owned by this thread.
+     * Stop when the sink return false, and the rows of that statement are
+     * not counted in RowDone(), so can call Next() or Run() to resume.
+     * @return number of statements accepted by sink.
+     * */
+    int Run(sql_sink_t sink);
+
+    /** generate the rest rows by multiple threads, append to output.
+     * @param threads: max number of thread, 0 for hardware concurrency.
+     * @details Split the rows into ranges, each thread format it's range
+     * to own buffer, and then the result is collected in order.
+     * The overload for vector output separate statements as limited, while
+     * the overload for string output one statement ignoring the limit.
+     * Small batch is not split, each thread has at least
+     * SQL_PARALLEL_MIN_ROWS rows.
+     * */
+    bool Parallel(std::vector<std::string>& sqls, int threads = 0);
+    bool Parallel(std::string& sql, int threads = 0);
+
+    bool Error() const { return m_error; }
+    size_t RowCount() const { return m_value ? m_value->Size() : 0; }
+    size_t RowDone() const { return m_next; }
+
+private:
+    bool Prepare(const rapidjson::Value& json);
+    bool PutRows(std::string& sql, size_t& next, size_t end,
+            std::vector<const rapidjson::Value*>& cell, bool limit) const;
+    std::vector<size_t> SplitRange(int threads) const;
+
+    const rapidjson::Value* m_value = nullptr;
     sql_config_t m_config;
+    std::string m_head;
+    std::string m_tail;
+    size_t m_columns = 0;
+    std::vector<const rapidjson::Value*> m_field;
+    std::vector<const rapidjson::Value*> m_cell;
+    size_t m_next = 0;
+    size_t m_maxRows = 1000;
+    size_t m_maxBytes = 0;
+    bool m_error = false;
+};
+
+/** PostgreSQL `COPY ... FROM STDIN` text format */
+const short SQL_BULK_COPY_TEXT = 0;
+/** PostgreSQL `COPY ... FROM STDIN WITH (FORMAT csv)` */
+const short SQL_BULK_COPY_CSV = 1;
+/** MySQL `LOAD DATA LOCAL INFILE` in default tab separated format */
+const short SQL_BULK_LOAD_DATA = 2;
+
+/** Export rows of insert json as data for database bulk loader.
+ * @details The input json is the same as sql_insert() with array value.
+ * Command() generate the sql to start bulk load, and Run() write the rows
+ * in data format to sink chunk by chunk, which can be piped to the
+ * database connection directly.
+ * Value is escaped as the format required:
+ * - text and tsv: null as `\N`, escape backslash, tab, newline and CR;
+ * - csv: null as empty, quote string with special char or empty string;
+ * - number as in json, bool as true/false, or 1/0 for MySQL;
+ * - object or array is written as json text;
+ * - string "`null`" as null, other raw sql in `` quote is invalid.
+ * @code
+ * CSqlBulkExport bulk(json, SQL_BULK_COPY_TEXT);
+ * std::string sql;
+ * bulk.Command(sql); // COPY t_name (f1,f2) FROM STDIN
+ * bulk.Run([&](const std::string& data) { return send(data); });
+ * @endcode
+ * */
+class CSqlBulkExport
+{
+public:
+    CSqlBulkExport(const rapidjson::Value& json, short format = SQL_BULK_COPY_TEXT);
+
+    /** append the command to start bulk load.
+     * @param file: the file name used in LOAD DATA, default "/dev/stdin".
+     * */
+    bool Command(std::string& sql, const char* file = nullptr) const;
+
+    /** write rows to sink, each chunk is about chunkBytes.
+     * @details Stop when the sink return false, and the rows of that chunk
+     * are not counted in RowDone().
+     * */
+    bool Run(sql_sink_t sink, size_t chunkBytes = 64 * 1024);
+
+    /** append all the rest rows to data */
+    bool Write(std::string& data);
+
+    bool Error() const { return m_error; }
+    size_t RowCount() const { return m_value ? m_value->Size() : 0; }
+    size_t RowDone() const { return m_next; }
+
+private:
+    bool Prepare(const rapidjson::Value& json);
+    bool PutRow(std::string& data, const rapidjson::Value& row);
+
+    const rapidjson::Value* m_value = nullptr;
+    short m_format;
+    std::string m_head;
+    size_t m_columns = 0;
+    std::vector<const rapidjson::Value*> m_field;
+    std::vector<const rapidjson::Value*> m_cell;
+    size_t m_next = 0;
+    bool m_error = false;
+};
+
+/** result set as array of object: [{"f1":v1, "f2":v2}, ...] */
+const short SQL_RESULT_ROWS = 0;
+/** result set as columnar: {"head":["f1","f2"], "value":[[v1,v2], ...]} */
+const short SQL_RESULT_COLUMNAR = 1;
+
+/** column type to convert cell text to json value */
+const short SQL_COLUMN_STRING = 0;
+const short SQL_COLUMN_INT = 1;
+const short SQL_COLUMN_DOUBLE = 2;
+const short SQL_COLUMN_BOOL = 3;
+
+/** get the text of cell in current row by column index.
+ * @return nullptr for sql NULL, and set the length of text.
+ * */
+typedef std::function<const char*(size_t col, size_t& len)> sql_cell_fn;
+
+/** Build json document from sql result set.
+ * @details Column names are set once, and the key strings are copied to
+ * the document allocator only once, then shared by each row object, whose
+ * member capacity is also reserved. The columnar shape is the same as the
+ * input of sql_insert() with array of array value, and much smaller.
+ * Cell text is converted by the column type, and kept as string if it is
+ * not a valid value of that type:
+ * - int: decimal integer in the range of int64;
+ * - double: finite decimal number, not nan, inf or hex float;
+ * - bool: only 1/t/true or 0/f/false, as MySQL and PostgreSQL output.
+ * @code
+ * rapidjson::Document doc;
+ * CSqlResultBuilder result(doc);
+ * for (i...) result.AddColumn(field[i].name, type);
+ * while ((row = mysql_fetch_row(res))) result.AddRow(row, mysql_fetch_lengths(res));
+ * @endcode
+ * */
+class CSqlResultBuilder
+{
+public:
+    CSqlResultBuilder(rapidjson::Document& doc, short shape = SQL_RESULT_ROWS);
+
+    /** add column before any row */
+    bool AddColumn(const char* name, short type = SQL_COLUMN_STRING);
+    /** reserve capacity for expected rows */
+    void Reserve(size_t rows);
+
+    /** append one row, get cell text by callback */
+    bool AddRow(const sql_cell_fn& cell);
+    /** append one row from text array, lengths can be nullptr for C string */
+    bool AddRow(const char* const* values, const size_t* lengths = nullptr);
+
+    size_t RowCount() const { return m_rows->Size(); }
+
+private:
+    void PutCell(rapidjson::Value& dest, const char* text, size_t len, short type);
+
+    rapidjson::Document& m_doc;
+    short m_shape;
+    rapidjson::Value* m_rows = nullptr;
+    std::vector<rapidjson::Value> m_keys;
+    std::vector<short> m_types;
 };
 
 } /* jsonkit */ 
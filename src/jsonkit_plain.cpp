@@ -7,6 +7,8 @@
 
 #include "jsonkit_plain.h"
 #include "jsonkit_rpdjn.h"
+#include "CJsonSchema.h"
+#include "jsonkit_internal.h"
 
 namespace jsonkit
 {
@@ -86,66 +88,45 @@ bool from_schema(const std::string& inSchema, std::string& outJson)
 /* -------------------------------------------------- */
 
 // validate the json according to schema
+// parse inJson and validate in one pass, not build DOM for it
 bool validate_schema(const std::string& inJson, const std::string& inSchema)
 {
-    rapidjson::Document docJson;
-    if (!read_string(docJson, inJson))
-    {
-        return false;
-    }
-
     rapidjson::Document docSchema;
     if (!read_string(docSchema, inSchema))
     {
         return false;
     }
 
-    return validate_schema(docJson, docSchema);
+    return validate_schema_text(inJson.c_str(), inJson.size(), docSchema);
 }
 
 bool validate_schema(const std::string& inJson, const std::string& inSchema, const std::string& basedir)
 {
-    rapidjson::Document docJson;
-    if (!read_string(docJson, inJson))
-    {
-        return false;
-    }
-
     rapidjson::Document docSchema;
     if (!read_string(docSchema, inSchema))
     {
         return false;
     }
 
-    return validate_schema(docJson, docSchema, basedir);
+    return validate_schema_text(inJson.c_str(), inJson.size(), docSchema, basedir);
 }
 
+// the schema file is compiled once and cached in CSchemaRegistry
 bool validate_schema_file(const std::string& inJson, const std::string& inSchemaFile)
 {
-    rapidjson::Document docJson;
-    if (!read_string(docJson, inJson))
+    std::shared_ptr<const CJsonSchema> schema = CSchemaRegistry::Instance().Get(inSchemaFile);
+    if (!schema)
     {
         return false;
     }
 
-    rapidjson::Document docSchema;
-    if (!read_file(docSchema, inSchemaFile))
+    std::string strError;
+    bool bRet = schema->ValidateText(inJson.c_str(), inJson.size(), strError);
+    if (!strError.empty())
     {
-        return false;
+        LOGS(strError);
     }
-
-    std::string basedir;
-    size_t pos = inSchemaFile.find_last_of("/\\:");
-    if (pos == std::string::npos)
-    {
-        basedir = inSchemaFile;
-    }
-    else
-    {
-        basedir = inSchemaFile.substr(0, pos);
-    }
-
-    return validate_schema(docJson, docSchema, basedir);
+    return bRet;
 }
 
 /* -------------------------------------------------- */
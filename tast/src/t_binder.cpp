@@ -0,0 +1,151 @@
+#include "tinytast.hpp"
+#include "json_binder.h"
+
+#include <vector>
+
+struct BindAddress
+{
+    std::string city;
+    int zip = 0;
+};
+
+struct BindPerson
+{
+    int id = 0;
+    std::string name;
+    double score = 0;
+    bool active = false;
+    uint64_t big = 0;
+    std::vector<int> tags;
+    BindAddress home;
+    std::vector<BindAddress> others;
+};
+
+static
+const jsonkit::CJsonBinder<BindPerson>& person_binder()
+{
+    static jsonkit::CJsonBinder<BindAddress> s_address;
+    static jsonkit::CJsonBinder<BindPerson> s_person;
+    if (s_person.RequiredMask() == 0)
+    {
+        s_address.Field("city", &BindAddress::city, true)
+            .Field("zip", &BindAddress::zip);
+        s_person.Field("id", &BindPerson::id, true)
+            .Field("name", &BindPerson::name, true)
+            .Field("score", &BindPerson::score)
+            .Field("active", &BindPerson::active)
+            .Field("big", &BindPerson::big)
+            .Field("tags", &BindPerson::tags)
+            .Field("home", &BindPerson::home, s_address)
+            .Field("others", &BindPerson::others, s_address);
+    }
+    return s_person;
+}
+
+DEF_TAST(binder_struct, "test bind json to struct")
+{
+    auto& binder = person_binder();
+
+    DESC("bind all fields and skip unknown keys");
+    std::string json = R"json({"id": 1, "name": "Tom", "unknown": {"a": [1, {"b": 2}]},
+        "score": 90, "active": true, "big": 18446744073709551615, "tags": [3, 4],
+        "home": {"city": "Here", "zip": 100}, "skip": [[]],
+        "others": [{"city": "A"}, {"city": "B", "zip": 2, "more": null}]})json";
+    BindPerson person;
+    std::string error;
+    COUT(binder.Parse(json, person, &error), true);
+    COUT(error.empty(), true);
+    COUT(person.id, 1);
+    COUT(person.name, "Tom");
+    COUT(person.score, 90.0);
+    COUT(person.active, true);
+    COUT(person.big, UINT64_MAX);
+    COUT(person.tags.size(), 2);
+    COUT(person.tags[1], 4);
+    COUT(person.home.city, "Here");
+    COUT(person.home.zip, 100);
+    COUT(person.others.size(), 2);
+    COUT(person.others[1].city, "B");
+    COUT(person.others[1].zip, 2);
+
+    DESC("keys in any order, null as not present");
+    BindPerson other;
+    COUT(binder.Parse(R"json({"tags": [], "name": "Jim", "score": null, "id": 2})json", other, &error), true);
+    COUT(other.id, 2);
+    COUT(other.name, "Jim");
+    COUT(other.tags.empty(), true);
+}
+
+DEF_TAST(binder_error, "test bind json with invalid type")
+{
+    auto& binder = person_binder();
+    BindPerson person;
+    std::string error;
+
+    COUT(binder.Parse(R"json({"id": "1", "name": "Tom"})json", person, &error), false);
+    COUT(error, "INVALID /id AGAINST type: integer");
+
+    error.clear();
+    COUT(binder.Parse(R"json({"id": 1.5, "name": "Tom"})json", person, &error), false);
+    COUT(error, "INVALID /id AGAINST type: integer");
+
+    error.clear();
+    COUT(binder.Parse(R"json({"id": 3000000000, "name": "Tom"})json", person, &error), false);
+    COUT(error, "INVALID /id AGAINST type: integer");
+
+    error.clear();
+    COUT(binder.Parse(R"json({"id": 1})json", person, &error), false);
+    COUT(error, "INVALID /name AGAINST required: true");
+
+    error.clear();
+    COUT(binder.Parse(R"json({"id": 1, "name": null})json", person, &error), false);
+    COUT(error, "INVALID /name AGAINST required: true");
+
+    error.clear();
+    COUT(binder.Parse(R"json({"id": 1, "name": "Tom", "tags": [1, "2"]})json", person, &error), false);
+    COUT(error, "INVALID /tags/1 AGAINST type: integer");
+
+    error.clear();
+    COUT(binder.Parse(R"json({"id": 1, "name": "Tom", "others": [{"city": "A"}, {"zip": 1}]})json", person, &error), false);
+    COUT(error, "INVALID /others/1/city AGAINST required: true");
+
+    error.clear();
+    COUT(binder.Parse(R"json({"id": 1, "name": "Tom", "home": []})json", person, &error), false);
+    COUT(error, "INVALID /home AGAINST type: object");
+
+    error.clear();
+    COUT(binder.Parse(R"json([1, 2])json", person, &error), false);
+    COUT(error, "INVALID  AGAINST type: object");
+
+    error.clear();
+    COUT(binder.Parse(R"json({"id": 1, "name": "Tom")json", person, &error), false);
+    COUT(error);
+    COUT(error.find("Parse Json Error") != std::string::npos, true);
+}
+
+struct BindFlags
+{
+    std::vector<bool> flags;
+    int id = 0;
+};
+
+DEF_TAST(binder_bool_vector, "test bind json to vector of bool")
+{
+    jsonkit::CJsonBinder<BindFlags> binder;
+    binder.Field("flags", &BindFlags::flags).Field("id", &BindFlags::id);
+
+    BindFlags item;
+    std::string error;
+    COUT(binder.Parse(R"json({"flags": [true, false, true], "id": 1})json", item, &error), true);
+    COUT(item.flags.size(), 3);
+    COUT(item.flags[0], true);
+    COUT(item.flags[1], false);
+    COUT(item.flags[2], true);
+
+    COUT(binder.Parse(R"json({"flags": [false, 1], "id": 2})json", item, &error), false);
+    COUT(error, "INVALID /flags/1 AGAINST type: bool");
+
+    DESC("failed parse leaves the struct partly overwritten");
+    COUT(item.flags.size(), 1);
+    COUT(item.id, 1);
+}
@@ -3,6 +3,9 @@
 #include "json_output.h"
 #include "json_operator.h"
 
+#include <chrono>
+#include <stdlib.h>
+
 DEF_TAST(filter_null, "test filter null value")
 {
     std::string text = R"json({
@@ -92,6 +95,37 @@ DEF_TAST(filter_empty_rev, "test filter empty value recursively")
     COUT(jsonkit::stringfy(doc));
 }
 
+DEF_TAST(filter_empty_recursive, "test filter empty value recursively in one pass")
+{
+    std::string text = R"json({
+    "aaa": 1, "bbb":null, "ccc": "c11", "cc0": "",
+    "ddd": {"eee":{}, "ggg": [], "fff":""},
+    "DDD": [7,{},null,[],false],
+    "eee": {}, "fff": [{},{},{}]
+})json";
+
+    rapidjson::Document doc;
+    doc.Parse(text.c_str(), text.size());
+    COUT(doc.HasParseError(), false);
+    COUT(jsonkit::stringfy(doc));
+
+    jsonkit::empty_count_t count;
+    int filtered = jsonkit::filter_empty_recursive(doc, &count);
+    COUT(jsonkit::stringfy(doc));
+    COUT(filtered, 14);
+    COUT(count.total(), 14);
+    COUT(count.null_value, 2);
+    COUT(count.empty_string, 2);
+    COUT(count.empty_array, 3);
+    COUT(count.empty_object, 7);
+    COUT(doc.MemberCount(), 3);
+    COUT(doc["DDD"].Size(), 2);
+
+    DESC("nothing more to filter");
+    COUT(jsonkit::filter_empty_recursive(doc), 0);
+    COUT(jsonkit::filter_empty(doc), 0);
+}
+
 DEF_TAST(filter_key1, "test filter keys")
 {
     std::string text = R"json({
@@ -294,3 +328,225 @@ DEF_TAST(filter_map_3, "replace json encoded string to nest json value")
     COUT(eee[0].GetInt(), -100);
     COUT(eee[2].IsNull(), true);
 }
+
+DEF_TAST(filter_map_4, "number to string the same as stringfy")
+{
+    std::string text = R"json([
+    0, -100, 2147483648, -2147483649, 18446744073709551615, -9223372036854775808,
+    2.78, -0.5, 1e300, 1.7976931348623157e308, 123456789012345678901234567890.0,
+    true, false, null, "str"
+])json";
+
+    rapidjson::Document doc;
+    doc.Parse(text.c_str(), text.size());
+    COUT(doc.HasParseError(), false);
+
+    std::vector<std::string> expect;
+    for (auto it = doc.Begin(); it != doc.End(); ++it)
+    {
+        expect.push_back(jsonkit::to_string(*it));
+    }
+
+    jsonkit::map_to_string(doc, doc.GetAllocator());
+    COUT(jsonkit::stringfy(doc));
+    COUT(doc.Size(), expect.size());
+    for (size_t i = 0; i < expect.size(); ++i)
+    {
+        COUT(doc[i].IsString(), true);
+        COUT(doc[i].GetString(), expect[i]);
+    }
+}
+
+DEF_TAST(filter_pipeline, "run filter and map stages in one pass")
+{
+    std::string text = R"json({
+    "aaa": 1, "bbb": null, "ccc": "{\"xxx\": 1}",
+    "ddd": {"eee": null, "ggg": [null, null], "fff": 8.8},
+    "DDD": [7, {"hhh": null}, null, [], true],
+    "eee": {"iii": {"jjj": null}}
+})json";
+
+    rapidjson::Document doc;
+    doc.Parse(text.c_str(), text.size());
+    COUT(doc.HasParseError(), false);
+    COUT(jsonkit::stringfy(doc));
+
+    DESC("filter null and map to string, but keep empty container");
+    {
+        rapidjson::Document copy;
+        copy.CopyFrom(doc, copy.GetAllocator());
+        jsonkit::CJsonPipeline pipe;
+        pipe.FilterNull().MapToString();
+        int removed = pipe.Run(copy, copy.GetAllocator());
+        COUT(removed, 7);
+        COUT(jsonkit::stringfy(copy));
+        COUT(copy.MemberCount(), 5);
+        COUT(copy["ddd"].MemberCount(), 2);
+        COUT(copy["ddd"]["ggg"].Size(), 0);
+        COUT(copy["ddd"]["fff"].GetString(), std::string("8.8"));
+        COUT(copy["DDD"].Size(), 4);
+        COUT(copy["DDD"][3].GetString(), std::string("true"));
+    }
+
+    DESC("also remove empty container left behind in the same pass");
+    {
+        rapidjson::Document copy;
+        copy.CopyFrom(doc, copy.GetAllocator());
+        jsonkit::CJsonPipeline pipe;
+        pipe.FilterNull().MapToString().MapDecodeJson().RemoveEmpty();
+        int removed = pipe.Run(copy, copy.GetAllocator());
+        COUT(removed, 12);
+        COUT(jsonkit::stringfy(copy));
+        COUT(copy.MemberCount(), 4);
+        COUT(copy.HasMember("eee"), false);
+        COUT(copy["ccc"].IsObject(), true);
+        COUT(copy["ddd"].MemberCount(), 1);
+        COUT(copy["DDD"].Size(), 2);
+    }
+
+    DESC("compare with filter one after another");
+    {
+        rapidjson::Document copy;
+        copy.CopyFrom(doc, copy.GetAllocator());
+        std::vector<std::string> keys{"bbb", "ggg"};
+        jsonkit::filter_null(copy);
+        jsonkit::filter_key(copy, keys, false);
+        jsonkit::map_to_string(copy, copy.GetAllocator());
+        std::string expect = jsonkit::stringfy(copy);
+
+        copy.CopyFrom(doc, copy.GetAllocator());
+        jsonkit::CJsonPipeline pipe;
+        pipe.FilterNull().FilterKey(keys, false).MapToString();
+        pipe.Run(copy, copy.GetAllocator());
+        COUT(jsonkit::stringfy(copy), expect);
+    }
+}
+
+DEF_TAST(filter_lazy_json, "decode nested json string lazily")
+{
+    std::string text = R"json({
+    "aaa": "{\"AAA\": 11, \"BBB\": [1,2,3]}",
+    "bbb": "[1]",
+    "ccc": "{not a json string}",
+    "ddd": "[\"x\", {\"y\": \"{\\\"z\\\": 5}\"}]"
+})json";
+
+    rapidjson::Document doc;
+    doc.Parse(text.c_str(), text.size());
+    COUT(doc.HasParseError(), false);
+
+    DESC("validate json text without DOM");
+    COUT(jsonkit::is_json_text("{}", 2), true);
+    COUT(jsonkit::is_json_text("{3}", 3), false);
+    COUT(jsonkit::is_json_text("[1,2", 4), false);
+    COUT(jsonkit::is_json_text("[1,2] ", 6), false);
+    COUT(jsonkit::is_json_text("abc", 3), false);
+
+    DESC("decode on first access by path operator");
+    const rapidjson::Document& cdoc = doc;
+    jsonkit::CLazyJson lazy(cdoc);
+    COUT(lazy.Size(), 0);
+    int AAA = *(lazy / "aaa" / "AAA") | 0;
+    COUT(AAA, 11);
+    COUT(lazy.Size(), 1);
+    COUT(*(lazy / "aaa/BBB/2") | 0, 3);
+    COUT(*(lazy / "bbb" / 0) | 0, 1);
+    COUT(lazy.Size(), 2);
+
+    DESC("the source document is not changed");
+    COUT(doc["aaa"].IsString(), true);
+    COUT(doc["bbb"].IsString(), true);
+
+    DESC("invalid json string is left as string, and parsed only once");
+    COUT((lazy / "ccc")->IsString(), true);
+    COUT((lazy / "ccc")->IsString(), true);
+    COUT(lazy.Size(), 3);
+    COUT(!*(lazy / "ccc" / "x"), true);
+
+    DESC("nested encoded json in decoded value");
+    COUT(*(lazy / "ddd" / 1 / "y" / "z") | 0, 5);
+    COUT(lazy.Size(), 5);
+
+    DESC("not accessed string is not parsed");
+    jsonkit::CLazyJson other(cdoc);
+    COUT(*(other / "bbb" / 0) | 0, 1);
+    COUT(other.Size(), 1);
+    COUT(!*(other / "zzz"), true);
+}
+
+// build a tree with about `count` nodes, object of 10 scalar members in array
+static void build_bench_tree(rapidjson::Document& doc, size_t count)
+{
+    auto& allocator = doc.GetAllocator();
+    doc.SetArray();
+    for (size_t i = 0; i < count / 10; ++i)
+    {
+        rapidjson::Value item(rapidjson::kObjectType);
+        for (int j = 0; j < 10; ++j)
+        {
+            std::string key = "k" + std::to_string(j);
+            rapidjson::Value name(key.c_str(), key.size(), allocator);
+            rapidjson::Value value((int)(i + j));
+            item.AddMember(name, value, allocator);
+        }
+        doc.PushBack(item, allocator);
+    }
+}
+
+static int64_t elapsed_ms(std::chrono::steady_clock::time_point start)
+{
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+}
+
+// heavy case not run in full suite, run explicitly by `tast_jsonkit.exe filter_bench`
+DEF_TOOL(filter_bench, "compare std::function and template callback")
+{
+    // set env JSONKIT_BENCH_NODES=10000000 to run on 10M-node tree
+    size_t count = 100000;
+    const char* env = getenv("JSONKIT_BENCH_NODES");
+    if (env && atol(env) > 0)
+    {
+        count = atol(env);
+    }
+    COUT(count);
+
+    rapidjson::Document doc;
+    build_bench_tree(doc, count);
+
+    auto keepAll = [](const rapidjson::Value& name, const rapidjson::Value& value)
+    {
+        return !value.IsNull();
+    };
+    auto negative = [](rapidjson::Value& name, rapidjson::Value& value, rapidjson::Document::AllocatorType& allocator)
+    {
+        if (value.IsInt())
+        {
+            value.SetInt(-value.GetInt());
+        }
+    };
+
+    DESC("filter by std::function");
+    auto start = std::chrono::steady_clock::now();
+    jsonkit::json_filter_fn filterFn = keepAll;
+    COUT(jsonkit::json_filter(doc, filterFn), 0);
+    COUT(elapsed_ms(start));
+
+    DESC("filter by template");
+    start = std::chrono::steady_clock::now();
+    COUT(jsonkit::json_filter(doc, keepAll), 0);
+    COUT(elapsed_ms(start));
+
+    DESC("map by std::function");
+    start = std::chrono::steady_clock::now();
+    jsonkit::json_map_fn mapFn = negative;
+    jsonkit::map_replace(doc, doc.GetAllocator(), mapFn);
+    COUT(elapsed_ms(start));
+    COUT(doc[1]["k0"].GetInt(), -1);
+
+    DESC("map by template");
+    start = std::chrono::steady_clock::now();
+    jsonkit::map_replace(doc, doc.GetAllocator(), negative);
+    COUT(elapsed_ms(start));
+    COUT(doc[1]["k0"].GetInt(), 1);
+}
@@ -1,10 +1,18 @@
 #include "tinytast.hpp"
 #include "jsonkit_plain.h"
 #include "json_schema.h"
+#include "CJsonSchema.h"
+#include "json_output.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
 
 #include <fstream>
 #include <sstream>
 #include <regex>
+#include <atomic>
+#include <thread>
 
 // test generate schema from input{json}, that expect same as input{schema}
 static
@@ -1005,3 +1013,668 @@ DEF_TAST(schema_flat_format, "test flat schema custome error message")
 }
 
 }
+
+DEF_TAST(schema_flat_compiled, "test compiled flat schema")
+{
+    std::string schema = R"json([
+    { "name": "aaa", "type": "number", "required": true, "minValue": 1, "maxValue": 100 },
+    { "name": "bbb", "type": "number", "maxValue": 9.5 },
+    { "name": "ccc", "type": "string", "required": true, "minLength": 2, "pattern": "[a-z0-9]+" },
+    { "name": "ddd", "type": "array", "children": [
+      { "name": "eee", "type": "string", "required": true },
+      { "name": "fff", "type": "bool" }
+    ] },
+    { "name": "ggg", "type": "object", "children": [
+      { "name": "hhh", "type": "number or array", "required": true }
+    ] }
+])json";
+    std::string format = R"json({
+    "required": "the field '{/name}' is required in {path}",
+    "type": "the type of '{/name}' should be {sval}"
+})json";
+
+    rapidjson::Document inSchema;
+    inSchema.Parse(schema.c_str(), schema.size());
+    COUT(inSchema.HasParseError(), false);
+    rapidjson::Document docFormat;
+    docFormat.Parse(format.c_str(), format.size());
+    COUT(docFormat.HasParseError(), false);
+
+    jsonkit::CFlatSchemaCompiled compiled;
+    COUT(compiled.Compiled(), false);
+    COUT(compiled.Compile(inSchema), true);
+    COUT(compiled.Compiled(), true);
+
+    // compiled schema holds its own copy
+    jsonkit::CFlatSchemaCompiled formated(inSchema, &docFormat);
+    COUT(formated.Compiled(), true);
+
+    const char* cases[] = {
+        R"json({"aaa": 1, "ccc": "c11"})json",
+        R"json({"aaa": 1, "bbb": 2.5, "ccc": "c11", "ddd": [{"eee":"e1"}, {"eee":"e2", "fff":true}], "ggg": {"hhh": [1,2]}})json",
+        R"json({"aaa": 1, "ccc": "c11", "ggg": {"hhh": 3}})json",
+        R"json({"ccc": "c11"})json",
+        R"json({"aaa": 0, "ccc": "c11"})json",
+        R"json({"aaa": 101, "ccc": "c11"})json",
+        R"json({"aaa": 1, "bbb": 9.6, "ccc": "c11"})json",
+        R"json({"aaa": 1, "ccc": "c"})json",
+        R"json({"aaa": 1, "ccc": "c11#"})json",
+        R"json({"aaa": "1", "ccc": "c11"})json",
+        R"json({"aaa": 1, "ccc": "c11", "ddd": [{"eee":"e1"}, {"fff":true}]})json",
+        R"json({"aaa": 1, "ccc": "c11", "ddd": [{"eee":"e1", "fff":1}]})json",
+        R"json({"aaa": 1, "ccc": "c11", "ddd": {"eee":"e1"}})json",
+        R"json({"aaa": 1, "ccc": "c11", "ggg": {"hhh": ["1"]}})json",
+        R"json({"aaa": 1, "ccc": "c11", "ggg": {}})json",
+    };
+
+    DESC("compiled schema should behave the same as validate_flat_schema");
+    for (auto json : cases)
+    {
+        rapidjson::Document inJson;
+        inJson.Parse(json);
+        COUT(inJson.HasParseError(), false);
+
+        std::string expect;
+        bool ret = jsonkit::validate_flat_schema(inJson, inSchema, expect);
+        std::string error;
+        COUT(compiled.Validate(inJson, error), ret);
+        COUT(error, expect);
+        COUT(compiled.Validate(inJson), ret);
+
+        expect.clear();
+        error.clear();
+        ret = jsonkit::validate_flat_schema(inJson, inSchema, expect, &docFormat);
+        COUT(formated.Validate(inJson, error), ret);
+        COUT(error, expect);
+    }
+
+    DESC("reuse compiled schema repeatedly");
+    rapidjson::Document inJson;
+    inJson.Parse(cases[1]);
+    int pass = 0;
+    for (int i = 0; i < 1000; ++i)
+    {
+        if (compiled.Validate(inJson))
+        {
+            ++pass;
+        }
+    }
+    COUT(pass, 1000);
+
+    DESC("invalid schema that is not array");
+    rapidjson::Document badSchema;
+    badSchema.Parse(R"json({"name": "aaa"})json");
+    COUT(compiled.Compile(badSchema), false);
+    COUT(compiled.Compiled(), false);
+    COUT(compiled.Validate(inJson), false);
+}
+
+DEF_TAST(schema_shared_threads, "test one json schema shared by threads")
+{
+    rapidjson::Document docSchema;
+    docSchema.Parse(R"json({ "type": "object",
+        "properties": { "aaa": { "type": "integer" }, "bbb": { "type": "string", "maxLength": 3 } },
+        "required":["aaa","bbb"] })json");
+    COUT(docSchema.HasParseError(), false);
+
+    rapidjson::Document docGood;
+    docGood.Parse(R"json({"aaa": 1, "bbb": "b1"})json");
+    rapidjson::Document docBad;
+    docBad.Parse(R"json({"aaa": 1, "bbb": "b1234"})json");
+
+    const jsonkit::CJsonSchema schema(docSchema);
+    std::string error;
+    COUT(schema.Validate(docGood, error), true);
+    COUT(error.empty(), true);
+    COUT(schema.Validate(docBad, error), false);
+    COUT(error);
+    std::string expect = error;
+
+    DESC("validator is reused from pool");
+    rapidjson::SchemaValidator* validator = schema.Acquire();
+    schema.Release(validator);
+    COUT(schema.Acquire() == validator, true);
+    schema.Release(validator);
+
+    DESC("validate concurrently in threads");
+    std::atomic<int> mismatch(0);
+    std::vector<std::thread> workers;
+    for (int t = 0; t < 8; ++t)
+    {
+        workers.emplace_back([&]() {
+            for (int i = 0; i < 2000; ++i)
+            {
+                std::string err;
+                if (!schema.Validate(docGood, err) || !err.empty())
+                {
+                    ++mismatch;
+                }
+                if (schema.Validate(docBad, err) || err != expect)
+                {
+                    ++mismatch;
+                }
+            }
+        });
+    }
+    for (auto& th : workers)
+    {
+        th.join();
+    }
+    COUT(mismatch.load(), 0);
+}
+
+DEF_TAST(schema_stream_text, "test validate raw json text in one pass")
+{
+    rapidjson::Document docSchema;
+    docSchema.Parse(R"json({ "type": "object",
+        "properties": { "aaa": { "type": "integer" }, "bbb": { "type": "array", "items": {"type": "integer"} } },
+        "required":["aaa"] })json");
+    COUT(docSchema.HasParseError(), false);
+    const jsonkit::CJsonSchema schema(docSchema);
+
+    std::string good = R"json({"aaa": 1, "bbb": [1,2,3]})json";
+    std::string bad = R"json({"aaa": 1, "bbb": [1,"2",3]})json";
+    std::string broken = R"json({"aaa": 1, "bbb": [1,2,3})json";
+
+    DESC("validate without DOM");
+    std::string error;
+    COUT(schema.ValidateText(good.c_str(), good.size(), error), true);
+    COUT(error.empty(), true);
+    COUT(schema.ValidateText(bad.c_str(), bad.size(), error), false);
+    COUT(error);
+    COUT(error.find("/bbb/1") != std::string::npos, true);
+    error.clear();
+    COUT(schema.ValidateText(broken.c_str(), broken.size(), error), false);
+    COUT(error);
+    COUT(error.find("Parse Json Error") != std::string::npos, true);
+
+    DESC("build DOM only when valid");
+    rapidjson::Document doc;
+    error.clear();
+    COUT(schema.ValidateText(good.c_str(), good.size(), error, &doc), true);
+    COUT(doc["bbb"][2].GetInt(), 3);
+    COUT(schema.ValidateText(bad.c_str(), bad.size(), error, &doc), false);
+    COUT(doc["bbb"][1].GetInt(), 2);
+
+    DESC("plain interface validate text directly");
+    std::string strSchema = R"json({ "type": "array", "items": { "type": "integer" } })json";
+    COUT(jsonkit::validate_schema("[0,1,2]", strSchema), true);
+    COUT(jsonkit::validate_schema("[0,true,2]", strSchema), false);
+    COUT(jsonkit::validate_schema("[0,1,2", strSchema), false);
+}
+
+static
+void util_write_file(const std::string& file, const std::string& content)
+{
+    std::ofstream outFile(file.c_str());
+    outFile << content;
+}
+
+DEF_TAST(schema_registry, "test cached schema file with remote ref")
+{
+    const char* tmpdir = getenv("TMPDIR");
+    std::string dir = std::string(tmpdir ? tmpdir : "/tmp") + "/tast_registry_XXXXXX";
+    COUT(mkdtemp(&dir[0]) != nullptr, true);
+    std::string mainFile = dir + "/main.json";
+    std::string refFile = dir + "/ref.json";
+    util_write_file(refFile, R"json({ "type": "integer" })json");
+    util_write_file(mainFile, R"json({ "type": "object",
+        "properties": { "aaa": { "$ref": "ref.json" } },
+        "required": ["aaa"] })json");
+
+    jsonkit::CSchemaRegistry& registry = jsonkit::CSchemaRegistry::Instance();
+    registry.Clear();
+
+    DESC("compile schema file only once");
+    COUT(jsonkit::validate_schema_file(R"json({"aaa": 1})json", mainFile), true);
+    COUT(jsonkit::validate_schema_file(R"json({"aaa": "1"})json", mainFile), false);
+    COUT(registry.Size(), 2);
+    auto schema = registry.Get(mainFile);
+    COUT(!!schema, true);
+    COUT(registry.Get(mainFile) == schema, true);
+
+    DESC("not check file again within interval");
+    // wait for the coarse file system clock, then modify in the same size
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    util_write_file(refFile, R"json({ "type": "string"  })json");
+    COUT(registry.Get(mainFile) == schema, true);
+
+    DESC("recompile when remote ref file modified");
+    registry.Invalidate();
+    COUT(jsonkit::validate_schema_file(R"json({"aaa": "1"})json", mainFile), true);
+    COUT(jsonkit::validate_schema_file(R"json({"aaa": 1})json", mainFile), false);
+    COUT(registry.Get(mainFile) != schema, true);
+
+    DESC("old schema in use is still valid");
+    rapidjson::Document doc;
+    doc.Parse(R"json({"aaa": 1})json");
+    COUT(schema->Validate(doc), true);
+
+    DESC("missing schema file");
+    COUT(!registry.Get(dir + "/none.json"), true);
+    registry.Clear();
+    COUT(registry.Size(), 0);
+
+    remove(mainFile.c_str());
+    remove(refFile.c_str());
+    rmdir(dir.c_str());
+}
+
+DEF_TAST(schema_array_parallel, "test validate large array in parallel")
+{
+    rapidjson::Document docArray;
+    docArray.SetArray();
+    auto& allocator = docArray.GetAllocator();
+    for (int i = 0; i < 1000; ++i)
+    {
+        rapidjson::Value item(rapidjson::kObjectType);
+        if (i == 10 || i == 500 || i == 999)
+        {
+            item.AddMember("aaa", "bad", allocator);
+        }
+        else
+        {
+            item.AddMember("aaa", i, allocator);
+        }
+        docArray.PushBack(item, allocator);
+    }
+
+    rapidjson::Document docSchema;
+    docSchema.Parse(R"json({ "type": "object",
+        "properties": { "aaa": { "type": "integer" } }, "required": ["aaa"] })json");
+    const jsonkit::CJsonSchema schema(docSchema);
+
+    rapidjson::Document docFlat;
+    docFlat.Parse(R"json([{ "name": "aaa", "type": "number", "required": true }])json");
+    const jsonkit::CFlatSchemaCompiled flat(docFlat);
+
+    DESC("report every invalid item");
+    std::vector<jsonkit::schema_item_error_t> errors;
+    COUT(schema.ValidateArray(docArray, errors, 4), false);
+    COUT(errors.size(), 3);
+    COUT(errors[0].index, 10);
+    COUT(errors[1].index, 500);
+    COUT(errors[2].index, 999);
+    COUT(errors[0].error);
+
+    errors.clear();
+    COUT(flat.ValidateArray(docArray, errors, 4), false);
+    COUT(errors.size(), 3);
+    COUT(errors[1].index, 500);
+    COUT(errors[1].error, "INVALID /aaa AGAINST type: number");
+
+    DESC("stop early after the first invalid item");
+    errors.clear();
+    COUT(flat.ValidateArray(docArray, errors, 1, true), false);
+    COUT(errors.size(), 1);
+    COUT(errors[0].index, 10);
+    errors.clear();
+    COUT(schema.ValidateArray(docArray, errors, 4, true), false);
+    COUT(errors.empty(), false);
+
+    DESC("all items valid");
+    docArray[10]["aaa"] = 10;
+    docArray[500]["aaa"] = 500;
+    docArray[999]["aaa"] = 999;
+    errors.clear();
+    COUT(schema.ValidateArray(docArray, errors), true);
+    COUT(flat.ValidateArray(docArray, errors), true);
+    COUT(errors.empty(), true);
+}
+
+DEF_TAST(schema_accumulate, "test accumulate schema from many samples")
+{
+    std::string ndjson = R"json({"id": 1, "name": "aa", "tag": "red", "score": [1, 2]}
+{"id": 2, "name": "bbbb", "tag": "blue", "score": [3.5]}
+
+{"id": 3, "tag": "red", "score": [], "extra": null}
+not a json
+{"id": 4, "name": "c", "tag": "blue", "score": [4, 5, 6]}
+)json";
+
+    jsonkit::CSchemaAccumulator acc;
+    COUT(acc.AddLines(ndjson.c_str(), ndjson.size()), 4);
+    COUT(acc.Count(), 4);
+
+    rapidjson::Document docSchema;
+    COUT(acc.Output(docSchema), true);
+    std::string schema;
+    jsonkit::stringfy(docSchema, schema);
+    COUT(schema);
+
+    COUT(docSchema["type"].GetString(), std::string("object"));
+    COUT(docSchema["required"].Size(), 3);
+    COUT(docSchema["properties"]["id"]["type"].GetString(), std::string("integer"));
+    COUT(docSchema["properties"]["id"]["maximum"].GetInt(), 4);
+    COUT(docSchema["properties"]["name"]["maxLength"].GetInt(), 4);
+    COUT(docSchema["properties"]["name"].HasMember("enum"), false);
+    COUT(docSchema["properties"]["tag"]["enum"].Size(), 2);
+    COUT(docSchema["properties"]["score"]["maxItems"].GetInt(), 3);
+    COUT(docSchema["properties"]["score"]["items"]["type"].GetString(), std::string("number"));
+    COUT(docSchema["properties"]["score"]["items"]["minimum"].GetDouble(), 1.0);
+
+    DESC("samples should be valid against the inferred schema");
+    rapidjson::Document docJson;
+    docJson.Parse(R"json({"id": 2, "name": "bbbb", "tag": "blue", "score": [3.5]})json");
+    COUT(jsonkit::validate_schema(docJson, docSchema), true);
+
+    DESC("merge accumulators of threads");
+    std::vector<std::unique_ptr<jsonkit::CSchemaAccumulator>> parts;
+    std::vector<std::thread> workers;
+    for (int t = 0; t < 4; ++t)
+    {
+        parts.emplace_back(new jsonkit::CSchemaAccumulator);
+    }
+    for (int t = 0; t < 4; ++t)
+    {
+        jsonkit::CSchemaAccumulator* part = parts[t].get();
+        workers.emplace_back([&ndjson, part]() {
+            for (int i = 0; i < 100; ++i)
+            {
+                part->AddLines(ndjson.c_str(), ndjson.size());
+            }
+        });
+    }
+    for (auto& th : workers)
+    {
+        th.join();
+    }
+    jsonkit::CSchemaAccumulator total;
+    for (auto& part : parts)
+    {
+        total.Merge(*part);
+    }
+    COUT(total.Count(), 1600);
+
+    rapidjson::Document docMerge;
+    COUT(total.Output(docMerge), true);
+    std::string merge;
+    jsonkit::stringfy(docMerge, merge);
+    COUT(merge, schema);
+
+    DESC("no enum if other type seen, exact bounds for big integer");
+    std::string mixed = R"json({"tag": "red", "big": 18446744073709551615}
+{"tag": "red", "big": 9223372036854775808}
+{"tag": null, "big": 18446744073709551615}
+)json";
+    jsonkit::CSchemaAccumulator accMixed;
+    COUT(accMixed.AddLines(mixed.c_str(), mixed.size()), 3);
+    rapidjson::Document docMixed;
+    COUT(accMixed.Output(docMixed), true);
+    std::string mixedSchema;
+    jsonkit::stringfy(docMixed, mixedSchema);
+    COUT(mixedSchema);
+    COUT(docMixed["properties"]["tag"].HasMember("enum"), false);
+    COUT(docMixed["properties"]["big"]["minimum"].GetUint64(), 9223372036854775808ULL);
+    COUT(docMixed["properties"]["big"]["maximum"].GetUint64(), 18446744073709551615ULL);
+    docJson.Parse(R"json({"tag": null, "big": 18446744073709551615})json");
+    COUT(jsonkit::validate_schema(docJson, docMixed), true);
+}
+
+DEF_TAST(schema_flat_modes, "test compiled flat schema validate modes")
+{
+    rapidjson::Document inSchema;
+    inSchema.Parse(R"json([
+    { "name": "aaa", "type": "number", "required": true },
+    { "name": "bbb", "type": "string", "maxLength": 3 },
+    { "name": "ccc", "type": "array of object", "children": [
+      { "name": "ddd", "type": "number", "required": true }
+    ] },
+    { "name": "eee", "type": "bool", "required": true }
+])json");
+    COUT(inSchema.HasParseError(), false);
+    const jsonkit::CFlatSchemaCompiled compiled(inSchema);
+
+    rapidjson::Document inJson;
+    inJson.Parse(R"json({"bbb": "b1234", "ccc": [{"ddd": 1}, {"ddd": "2"}, {}], "eee": true})json");
+    COUT(inJson.HasParseError(), false);
+
+    DESC("boolean mode");
+    COUT(compiled.Validate(inJson), false);
+
+    DESC("first error mode");
+    std::string error;
+    COUT(compiled.Validate(inJson, error), false);
+    COUT(error, "INVALID /aaa AGAINST required: true");
+
+    DESC("collect all errors");
+    std::vector<std::string> errors;
+    COUT(compiled.Validate(inJson, errors, 0), false);
+    COUT(errors.size(), 4);
+    COUT(errors[0], "INVALID /aaa AGAINST required: true");
+    COUT(errors[1], "INVALID /bbb AGAINST maxLength: 3");
+    COUT(errors[2], "INVALID /ccc/1/ddd AGAINST type: number");
+    COUT(errors[3], "INVALID /ccc/2/ddd AGAINST required: true");
+
+    DESC("collect limited errors");
+    errors.clear();
+    COUT(compiled.Validate(inJson, errors, 2), false);
+    COUT(errors.size(), 2);
+    COUT(errors[1], "INVALID /bbb AGAINST maxLength: 3");
+
+    DESC("valid json has no error in any mode");
+    inJson.Parse(R"json({"aaa": 1, "ccc": [{"ddd": 1}], "eee": false})json");
+    errors.clear();
+    error.clear();
+    COUT(compiled.Validate(inJson), true);
+    COUT(compiled.Validate(inJson, error), true);
+    COUT(compiled.Validate(inJson, errors, 0), true);
+    COUT(error.empty() && errors.empty(), true);
+}
+
+DEF_TAST(schema_sampler, "test generate many samples from schema")
+{
+    rapidjson::Document docSchema;
+    docSchema.Parse(R"json({ "type": "object",
+        "properties": {
+          "id": { "type": "integer", "minimum": 1, "maximum": 100 },
+          "name": { "type": "string", "minLength": 2, "maxLength": 8 },
+          "level": { "enum": ["low", "mid", "high"] },
+          "score": { "type": "number", "minimum": 0, "maximum": 1 },
+          "tags": { "type": "array", "items": {"type": "string"}, "minItems": 1, "maxItems": 3 },
+          "owner": { "type": "object", "properties": { "ok": {"type": "boolean"} }, "required": ["ok"] }
+        },
+        "required": ["id", "name", "level"] })json");
+    COUT(docSchema.HasParseError(), false);
+    const jsonkit::CJsonSchema schema(docSchema);
+
+    DESC("the same seed reproduce the same samples");
+    std::ostringstream first;
+    std::ostringstream second;
+    std::ostringstream other;
+    jsonkit::CSchemaSampler sampler(docSchema, 2026);
+    COUT(sampler.Stream(100, first), 100);
+    sampler.Seed(2026);
+    COUT(sampler.Stream(100, second), 100);
+    COUT(first.str() == second.str(), true);
+    sampler.Seed(1019);
+    COUT(sampler.Stream(100, other), 100);
+    COUT(first.str() == other.str(), false);
+
+    DESC("each line is valid against schema");
+    std::istringstream lines(first.str());
+    std::string line;
+    std::string error;
+    size_t count = 0;
+    size_t valid = 0;
+    while (std::getline(lines, line))
+    {
+        ++count;
+        if (schema.ValidateText(line.c_str(), line.size(), error))
+        {
+            ++valid;
+        }
+    }
+    COUT(count, 100);
+    COUT(valid, 100);
+    COUT(error.empty(), true);
+
+    DESC("generate into document");
+    rapidjson::Document doc;
+    COUT(sampler.Generate(doc), true);
+    COUT(doc.IsObject() && doc.HasMember("id") && doc.HasMember("name"), true);
+
+    DESC("generated document outlives the sampler");
+    rapidjson::Document kept;
+    {
+        jsonkit::CSchemaSampler temp(docSchema, 2026);
+        COUT(temp.Generate(kept), true);
+    }
+    std::string keptText;
+    jsonkit::stringfy(kept, keptText);
+    COUT(keptText);
+    COUT(kept.HasMember("id") && kept.HasMember("name") && kept.HasMember("level"), true);
+    COUT(schema.ValidateText(keptText.c_str(), keptText.size(), error), true);
+
+    DESC("sink in small chunks and stop early");
+    size_t chunks = 0;
+    auto sink = [&chunks](const std::string& chunk) {
+        return ++chunks < 3;
+    };
+    size_t accepted = sampler.Stream(1000, sink, 256);
+    COUT(chunks, 3);
+    COUT(accepted > 0 && accepted < 1000, true);
+    COUT(sampler.Unsupported(), 0);
+
+    DESC("exclusive bounds of number, long string and unsupported keyword");
+    rapidjson::Document docBound;
+    docBound.Parse(R"json({ "type": "object",
+        "properties": {
+          "ratio": { "type": "number", "minimum": 0, "maximum": 1,
+            "exclusiveMinimum": true, "exclusiveMaximum": true },
+          "text": { "type": "string", "minLength": 100, "maxLength": 200 },
+          "code": { "type": "string", "pattern": "^[0-9]+$" }
+        },
+        "required": ["ratio", "text"] })json");
+    jsonkit::CSchemaSampler bound(docBound, 2026);
+    COUT(bound.Unsupported(), 1);
+    size_t inside = 0;
+    size_t longText = 0;
+    for (int i = 0; i < 100; ++i)
+    {
+        rapidjson::Document sample;
+        bound.Generate(sample);
+        double ratio = sample["ratio"].GetDouble();
+        if (ratio > 0 && ratio < 1)
+        {
+            ++inside;
+        }
+        size_t length = sample["text"].GetStringLength();
+        if (length >= 100 && length <= 200)
+        {
+            ++longText;
+        }
+    }
+    COUT(inside, 100);
+    COUT(longText, 100);
+}
+
+DEF_TAST(schema_flat_stream, "test compiled flat schema validate json text by SAX")
+{
+    rapidjson::Document inSchema;
+    inSchema.Parse(R"json([
+    { "name": "aaa", "type": "number", "required": true, "maxValue": 100 },
+    { "name": "bbb", "type": "string", "maxLength": 3 },
+    { "name": "abc", "type": "string or array" },
+    { "name": "ccc", "type": "array of object", "children": [
+      { "name": "ddd", "type": "number", "required": true }
+    ] },
+    { "name": "eee", "type": "bool", "required": true },
+    { "name": "fff", "type": "object", "children": [
+      { "name": "ggg", "type": "string", "required": true }
+    ] },
+    { "name": "any" }
+])json");
+    COUT(inSchema.HasParseError(), false);
+    const jsonkit::CFlatSchemaCompiled compiled(inSchema);
+
+    auto check = [&compiled](const std::string& json, bool expect, const std::string& expectError) {
+        std::string error;
+        bool ret = compiled.ValidateText(json.c_str(), json.size(), error);
+        COUT(ret, expect);
+        COUT(compiled.ValidateText(json.c_str(), json.size()), expect);
+        COUT(error, expectError);
+
+        // the same as DOM validation when there is only one error
+        rapidjson::Document doc;
+        doc.Parse(json.c_str(), json.size());
+        if (!doc.HasParseError())
+        {
+            std::string domError;
+            COUT(compiled.Validate(doc, domError), expect);
+            COUT(domError, expectError);
+        }
+    };
+
+    DESC("valid text, unknown keys and untyped value are skipped");
+    check(R"json({"aaa": 1, "zzz": {"a": [1, {"b": []}]}, "abc": ["x", "y"], "any": [{}],
+        "ccc": [{"ddd": 1}, {"ddd": 2, "x": null}], "eee": true, "fff": {"ggg": "g"}})json", true, "");
+    check(R"json({"eee": false, "aaa": 2.5, "abc": "x", "bbb": null})json", true, "");
+
+    DESC("missing required key at end of object");
+    check(R"json({"aaa": 1})json", false, "INVALID /eee AGAINST required: true");
+    check(R"json({"aaa": 1, "eee": null})json", false, "INVALID /eee AGAINST required: true");
+    check(R"json({"aaa": 1, "eee": true, "ccc": [{"ddd": 1}, {}]})json", false, "INVALID /ccc/1/ddd AGAINST required: true");
+    check(R"json({"aaa": 1, "eee": true, "fff": {}})json", false, "INVALID /fff/ggg AGAINST required: true");
+
+    DESC("invalid scalar value");
+    check(R"json({"aaa": 101, "eee": true})json", false, "INVALID /aaa AGAINST maxValue: 100");
+    check(R"json({"aaa": 1, "bbb": "b1234", "eee": true})json", false, "INVALID /bbb AGAINST maxLength: 3");
+    check(R"json({"aaa": 1, "eee": true, "abc": [1]})json", false, "INVALID /abc/0 AGAINST type: string");
+    check(R"json({"aaa": 1, "eee": true, "ccc": [{"ddd": "1"}]})json", false, "INVALID /ccc/0/ddd AGAINST type: number");
+
+    DESC("invalid container value");
+    check(R"json({"aaa": 1, "eee": true, "ccc": {}})json", false, "INVALID /ccc AGAINST type: array");
+    check(R"json({"aaa": 1, "eee": true, "ccc": [[]]})json", false, "INVALID /ccc/0 AGAINST type: object");
+    check(R"json({"aaa": 1, "eee": true, "fff": []})json", false, "INVALID /fff AGAINST type: object");
+    check(R"json({"aaa": [1], "eee": true})json", false, "INVALID /aaa AGAINST type: number");
+    check(R"json([{"aaa": 1}])json", false, "INVALID  AGAINST type: object");
+
+    DESC("broken json text");
+    std::string error;
+    std::string broken = R"json({"aaa": 1, "eee": true)json";
+    COUT(compiled.ValidateText(broken.c_str(), broken.size(), error), false);
+    COUT(error);
+    COUT(error.find("Parse Json Error") != std::string::npos, true);
+
+    DESC("more than 64 keys in one level");
+    rapidjson::Document bigSchema;
+    bigSchema.SetArray();
+    std::string json = "{";
+    for (int i = 0; i < 100; ++i)
+    {
+        std::string name = "k" + std::to_string(i);
+        rapidjson::Value item(rapidjson::kObjectType);
+        item.AddMember("name", rapidjson::Value(name.c_str(), bigSchema.GetAllocator()), bigSchema.GetAllocator());
+        item.AddMember("type", "number", bigSchema.GetAllocator());
+        item.AddMember("required", true, bigSchema.GetAllocator());
+        bigSchema.PushBack(item, bigSchema.GetAllocator());
+        if (i != 90)
+        {
+            json.append(json.size() > 1 ? "," : "").append("\"").append(name).append("\":").append(std::to_string(i));
+        }
+    }
+    json.append("}");
+    const jsonkit::CFlatSchemaCompiled bigCompiled(bigSchema);
+    error.clear();
+    COUT(bigCompiled.ValidateText(json.c_str(), json.size(), error), false);
+    COUT(error, "INVALID /k90 AGAINST required: true");
+
+    DESC("duplicated name, the later one is required");
+    rapidjson::Document dupSchema;
+    dupSchema.Parse(R"json([
+    { "name": "id", "type": "number" },
+    { "name": "id", "type": "number", "required": true }
+])json");
+    const jsonkit::CFlatSchemaCompiled dupCompiled(dupSchema);
+    std::string dup = R"json({"id": 1})json";
+    rapidjson::Document dupDoc;
+    dupDoc.Parse(dup.c_str(), dup.size());
+    error.clear();
+    COUT(dupCompiled.ValidateText(dup.c_str(), dup.size(), error), true);
+    COUT(dupCompiled.Validate(dupDoc, error), true);
+    COUT(error.empty(), true);
+    dup = "{}";
+    COUT(dupCompiled.ValidateText(dup.c_str(), dup.size(), error), false);
+    COUT(error, "INVALID /id AGAINST required: true");
+}
@@ -1,5 +1,9 @@
 #include "tinytast.hpp"
 #include "json_sqlbuilder.h"
+#include "json_output.h"
+
+#include <atomic>
+#include <thread>
 
 DEF_TAST(sql_insert, "build insert sql")
 {
@@ -1076,7 +1080,774 @@ DEF_TAST(sql_whereor_1, "tast or relation in where")
     COUT(doc.HasParseError(), false);
 
     std::string sql;
-    std::string sqlExpect = "SELECT * FROM t_name WHERE 1=1 AND (1!=1 OR user=1001 OR id IN (100,200,300) OR key>10 OR key<20) AND date<=now()";
+    std::string sqlExpect = "SELECT * FROM t_name WHERE 1=1 AND (user=1001 OR id IN (100,200,300) OR key>10 OR key<20) AND date<=now()";
     COUT(jsonkit::sql_select(doc, sql), true);
     COUT(sql, sqlExpect);
 }
+
+DEF_TAST(sql_prepared, "tast prepared statement with placeholder")
+{
+    jsonkit::CSqlBuilder sb;
+
+    DESC("select with placeholder ?");
+    {
+    std::string jsonText = R"json({
+    "table": "t_name",
+    "where": {
+        "user": 1001,
+        "id": [100, 200, 300],
+        "name": { "like": "abc" },
+        "flag": { "ne": true, "null": false },
+        "date": { "le": "`now()`" },
+        "note": null
+    },
+    "limit": [10, 20]
+})json";
+
+    COUT(jsonText);
+    rapidjson::Document doc;
+    doc.Parse(jsonText.c_str(), jsonText.size());
+    COUT(doc.HasParseError(), false);
+
+    std::string sql;
+    jsonkit::sql_param_t params;
+    std::string sqlExpect = "SELECT * FROM t_name WHERE 1=1 AND user=? AND id IN (?,?,?) AND name like CONCAT(?,'%') AND flag!=? AND flag is not NULL AND date<=now() LIMIT ?,?";
+    COUT(sb.Select(doc, sql, params), true);
+    COUT(sql, sqlExpect);
+    COUT(params.size(), 8);
+    COUT(params[0] == &doc["where"]["user"], true);
+    COUT(params[3]->GetInt(), 300);
+    COUT(params[4]->GetString(), std::string("abc"));
+    COUT(params[5]->IsBool(), true);
+    COUT(params[7]->GetInt(), 20);
+    }
+
+    DESC("the same shape generate the same sql");
+    {
+        rapidjson::Document doc1, doc2;
+        doc1.Parse(R"json({"table":"t_name", "value":[{"f1":"a", "f2":1}, {"f1":"b", "f2":2}]})json");
+        doc2.Parse(R"json({"table":"t_name", "value":[{"f1":"x'y", "f2":3}, {"f1":"z", "f2":4}]})json");
+        std::string sql1, sql2;
+        jsonkit::sql_param_t params1, params2;
+        COUT(sb.Insert(doc1, sql1, params1), true);
+        COUT(sb.Insert(doc2, sql2, params2), true);
+        COUT(sql1, "INSERT INTO t_name (f1,f2) VALUES (?,?), (?,?)");
+        COUT(sql1 == sql2, true);
+        COUT(params2.size(), 4);
+        COUT(params2[0]->GetString(), std::string("x'y"));
+        COUT(params2[3]->GetInt(), 4);
+    }
+
+    DESC("placeholder in $n style");
+    sb.Config().placeholder = jsonkit::SQL_PLACEHOLDER_DOLLAR;
+    {
+        rapidjson::Document doc;
+        doc.Parse(R"json({"table":"t_name", "value":{"f1":"a", "f2":1}, "where":{"id":[1,2]}})json");
+        std::string sql;
+        jsonkit::sql_param_t params;
+        COUT(sb.Update(doc, sql, params), true);
+        COUT(sql, "UPDATE t_name SET f1=$1,f2=$2 WHERE 1=1 AND id IN ($3,$4)");
+        COUT(params.size(), 4);
+    }
+
+    DESC("like pattern with escape config is still inline");
+    sb.Config().escape_like_metachar = true;
+    {
+        rapidjson::Document doc;
+        doc.Parse(R"json({"table":"t_name", "where":{"name":{"like":"a_b"}}})json");
+        std::string sql;
+        jsonkit::sql_param_t params;
+        COUT(sb.Select(doc, sql, params), true);
+        COUT(sql, "SELECT * FROM t_name WHERE 1=1 AND name like 'a\\_b%'");
+        COUT(params.empty(), true);
+    }
+}
+
+DEF_TAST(sql_template_cache, "tast cache sql template by json shape")
+{
+    jsonkit::CSqlTemplateCache cache(2);
+    jsonkit::CSqlBuilder sb;
+
+    std::vector<std::string> jsonList = {
+        R"json({"table":"t_name", "where":{"id":1, "name":{"like":"a'b"}, "age":{"between":[10,20]}}, "order":"id", "limit":10})json",
+        R"json({"table":"t_name", "where":{"id":2, "name":{"like":"cd"}, "age":{"between":[30,40]}}, "order":"id", "limit":20})json",
+        R"json({"table":"t_other", "where":{"id":3, "name":{"like":"ef"}, "age":{"between":[50,60]}}, "order":"id", "limit":30})json",
+        R"json({"table":"t_name", "where":{"id":4, "name":{"like":"gh"}, "age":{"between":[70,80]}}, "order":"age", "limit":40})json",
+        R"json({"table":"t_name", "where":{"id":5, "name":{"like":"ij"}, "age":{"between":[90,99]}}, "order":"id", "limit":50})json",
+    };
+
+    DESC("cached sql is the same as normal builder");
+    for (auto& jsonText : jsonList)
+    {
+        rapidjson::Document doc;
+        doc.Parse(jsonText.c_str(), jsonText.size());
+        std::string sql, sqlExpect;
+        COUT(cache.Select(doc, sql), true);
+        COUT(sb.Select(doc, sqlExpect), true);
+        COUT(sql, sqlExpect);
+    }
+
+    auto stat = cache.Stat();
+    COUT(stat.hit, 2);
+    COUT(stat.miss, 3);
+    COUT(stat.size, 1);
+    COUT(stat.HitRate());
+
+    DESC("different shape for batch insert");
+    {
+        rapidjson::Document doc;
+        doc.Parse(R"json({"table":"t_name", "value":[{"f1":"a", "f2":1, "f3":null}, {"f1":"b", "f2":"`now()`"}]})json");
+        std::string sql, sqlExpect;
+        COUT(cache.Insert(doc, sql), true);
+        COUT(sb.Insert(doc, sqlExpect), true);
+        COUT(sql, sqlExpect);
+
+        doc.Parse(R"json({"table":"t_name", "value":[{"f1":"c", "f2":2, "f3":null}, {"f1":"d", "f2":"`now()`"}]})json");
+        sql.clear();
+        COUT(cache.Insert(doc, sql), true);
+        COUT(sql, "INSERT INTO t_name (f1,f2) VALUES ('c',2), ('d',now())");
+    }
+
+    DESC("capacity bound the number of shape");
+    {
+        rapidjson::Document doc;
+        doc.Parse(R"json({"table":"t_name", "where":{"id":1}})json");
+        std::string sql;
+        COUT(cache.Delete(doc, sql), true);
+        COUT(sql, "DELETE FROM t_name WHERE 1=1 AND id=1");
+        stat = cache.Stat();
+        COUT(stat.size, 2);
+        COUT(stat.evict, 1);
+    }
+
+    DESC("invalid json is not cached");
+    {
+        rapidjson::Document doc;
+        doc.Parse(R"json({"table":"t_name"})json");
+        std::string sql;
+        COUT(cache.Delete(doc, sql), false);
+        COUT(cache.Delete(doc, sql), false);
+        COUT(cache.Stat().hit, 3);
+    }
+}
+
+DEF_TAST(sql_escape_long, "tast escape long string value")
+{
+    std::string text;
+    std::string escape;
+    std::string like;
+    for (int i = 0; i < 100; ++i)
+    {
+        text.append(i % 7, 'a');
+        escape.append(i % 7, 'a');
+        like.append(i % 7, 'a');
+        const char* special = (i % 3 == 0) ? "'" : ((i % 3 == 1) ? "%" : "_");
+        text.append(special);
+        escape.append(special);
+        if (special[0] == '\'')
+        {
+            escape.append(special);
+            like.append("''");
+        }
+        else
+        {
+            like.append("\\").append(special);
+        }
+    }
+
+    rapidjson::Document doc;
+    doc.SetObject();
+    auto& allocator = doc.GetAllocator();
+    doc.AddMember("table", "t_name", allocator);
+    rapidjson::Value value(rapidjson::kObjectType);
+    value.AddMember("f1", rapidjson::Value(text.c_str(), text.size(), allocator), allocator);
+    doc.AddMember("value", value, allocator);
+
+    std::string sql;
+    COUT(jsonkit::sql_insert(doc, sql), true);
+    COUT(sql == "INSERT INTO t_name SET f1='" + escape + "'", true);
+
+    DESC("escape like meta char and quote");
+    jsonkit::CSqlBuilder sb;
+    sb.Config().escape_like_metachar = true;
+    sb.Config().fix_like_value = 0;
+    rapidjson::Value where(rapidjson::kObjectType);
+    rapidjson::Value cmp(rapidjson::kObjectType);
+    cmp.AddMember("like", rapidjson::Value(text.c_str(), text.size(), allocator), allocator);
+    where.AddMember("f1", cmp, allocator);
+    doc.AddMember("where", where, allocator);
+
+    sql.clear();
+    COUT(sb.Select(doc, sql), true);
+    COUT(sql == "SELECT * FROM t_name WHERE 1=1 AND f1 like '" + like + "'", true);
+}
+
+DEF_TAST(sql_batch_insert, "tast batch insert in chunks")
+{
+    rapidjson::Document doc;
+    doc.Parse(R"json({
+    "table": "t_name",
+    "value": [
+        {"id":1, "name":"a", "note":null},
+        {"id":2, "name":"b"},
+        {"name":"c", "id":3},
+        {"id":4},
+        {"id":5, "name":"e'e", "age":50}
+    ]
+})json");
+    COUT(doc.HasParseError(), false);
+
+    DESC("limit by row count");
+    {
+        jsonkit::CSqlBatchInsert batch(doc);
+        batch.MaxRows(2);
+        std::vector<std::string> sqls;
+        std::string sql;
+        while (batch.Next(sql))
+        {
+            sqls.push_back(sql);
+        }
+        COUT(batch.Error(), false);
+        COUT(batch.RowDone(), 5);
+        COUT(sqls.size(), 3);
+        COUT(sqls[0], "INSERT INTO t_name (id,name) VALUES (1,'a'), (2,'b')");
+        COUT(sqls[1], "INSERT INTO t_name (id,name) VALUES (3,'c'), (4,null)");
+        COUT(sqls[2], "INSERT INTO t_name (id,name) VALUES (5,'e''e')");
+    }
+
+    DESC("the same as sql_insert without limit");
+    {
+        jsonkit::CSqlBatchInsert batch(doc);
+        batch.MaxRows(0);
+        std::string sql, sqlExpect;
+        COUT(batch.Next(sql), true);
+        COUT(jsonkit::sql_insert(doc, sqlExpect), true);
+        COUT(sql, sqlExpect);
+        COUT(batch.Next(sql), false);
+    }
+
+    DESC("limit by bytes");
+    {
+        jsonkit::CSqlBatchInsert batch(doc);
+        batch.MaxBytes(60);
+        std::string sql;
+        int count = 0;
+        while (batch.Next(sql))
+        {
+            COUT(sql);
+            COUT(sql.size() <= 60, true);
+            ++count;
+        }
+        COUT(count, 3);
+    }
+
+    DESC("array rows with field, and run with sink");
+    {
+        rapidjson::Document doc;
+        doc.Parse(R"json({
+    "table": "t_name",
+    "field": ["id", "name"],
+    "value": [[1,"a"], [2,"b"], [3,"c"], [4,"d"], [5,"e"]],
+    "update": {"name": "`values(name)`"}
+})json");
+        jsonkit::CSqlBatchInsert batch(doc);
+        batch.MaxRows(2);
+        std::vector<std::string> sqls;
+        std::thread::id caller = std::this_thread::get_id();
+        bool sameThread = true;
+        int count = batch.Run([&sqls, &caller, &sameThread](const std::string& sql) {
+            sqls.push_back(sql);
+            sameThread = sameThread && std::this_thread::get_id() == caller;
+            return true;
+        });
+        COUT(count, 3);
+        COUT(sameThread, true);
+        COUT(sqls.size(), 3);
+        COUT(sqls[0], "INSERT INTO t_name (id,name) VALUES (1,'a'), (2,'b') ON DUPLICATE KEY UPDATE name=values(name)");
+        COUT(sqls[2], "INSERT INTO t_name (id,name) VALUES (5,'e') ON DUPLICATE KEY UPDATE name=values(name)");
+
+        DESC("stop by sink and resume");
+        jsonkit::CSqlBatchInsert batch2(doc);
+        batch2.MaxRows(2);
+        count = batch2.Run([](const std::string& sql) {
+            return sql.find("(3,'c')") == std::string::npos;
+        });
+        COUT(count, 1);
+        COUT(batch2.RowDone(), 2);
+        std::string sql;
+        COUT(batch2.Next(sql), true);
+        COUT(sql, "INSERT INTO t_name (id,name) VALUES (3,'c'), (4,'d') ON DUPLICATE KEY UPDATE name=values(name)");
+    }
+
+    DESC("invalid row");
+    {
+        rapidjson::Document doc;
+        doc.Parse(R"json({"table":"t_name", "field":["id","name"], "value":[[1,"a"], [2]]})json");
+        jsonkit::CSqlBatchInsert batch(doc);
+        std::string sql;
+        COUT(batch.Next(sql), false);
+        COUT(batch.Error(), true);
+    }
+}
+
+DEF_TAST(sql_batch_parallel, "tast batch insert by multiple threads")
+{
+    rapidjson::Document doc;
+    doc.SetObject();
+    auto& allocator = doc.GetAllocator();
+    doc.AddMember("table", "t_name", allocator);
+    rapidjson::Value value(rapidjson::kArrayType);
+    for (int i = 0; i < 5000; ++i)
+    {
+        rapidjson::Value row(rapidjson::kObjectType);
+        row.AddMember("id", i, allocator);
+        std::string name = "name'" + std::to_string(i);
+        row.AddMember("name", rapidjson::Value(name.c_str(), name.size(), allocator), allocator);
+        value.PushBack(row, allocator);
+    }
+    doc.AddMember("value", value, allocator);
+
+    DESC("one statement the same as sql_insert");
+    {
+        std::string sql, sqlExpect;
+        jsonkit::CSqlBatchInsert batch(doc);
+        COUT(batch.Parallel(sql, 4), true);
+        COUT(batch.RowDone(), 5000);
+        COUT(jsonkit::sql_insert(doc, sqlExpect), true);
+        COUT(sql.size(), sqlExpect.size());
+        COUT(sql == sqlExpect, true);
+    }
+
+    DESC("separate statements the same as Next()");
+    {
+        jsonkit::CSqlBatchInsert batch(doc);
+        batch.MaxRows(700);
+        std::vector<std::string> sqls;
+        COUT(batch.Parallel(sqls, 4), true);
+        COUT(sqls.size(), 8);
+
+        jsonkit::CSqlBatchInsert batch2(doc);
+        batch2.MaxRows(700);
+        std::vector<std::string> sqlsExpect;
+        std::string sql;
+        while (batch2.Next(sql))
+        {
+            sqlsExpect.push_back(sql);
+        }
+        COUT(sqls == sqlsExpect, true);
+    }
+}
+
+DEF_TAST(sql_dialect, "tast sql dialect for MySQL and PostgreSQL")
+{
+    jsonkit::CSqlBuilder my;
+    jsonkit::CSqlBuilder pg;
+    pg.Config() = jsonkit::sql_dialect_config(jsonkit::SQL_DIALECT_POSTGRES);
+    COUT(pg.Config().placeholder, jsonkit::SQL_PLACEHOLDER_DOLLAR);
+
+    DESC("escape backslash only if config");
+    {
+        rapidjson::Document doc;
+        doc.Parse(R"json({"table":"t_name", "value":{"path":"C:\\dir\\'x'"}})json");
+        std::string sql;
+        COUT(my.Insert(doc, sql), true);
+        COUT(sql, "INSERT INTO t_name SET path='C:\\dir\\''x'''");
+        sql.clear();
+        COUT(pg.Insert(doc, sql), true);
+        COUT(sql, "INSERT INTO t_name (path) VALUES ('C:\\dir\\''x''')");
+
+        jsonkit::CSqlBuilder escape;
+        escape.Config().escape_backslash = true;
+        sql.clear();
+        COUT(escape.Insert(doc, sql), true);
+        COUT(sql, "INSERT INTO t_name SET path='C:\\\\dir\\\\''x'''");
+
+        DESC("backslash in like pattern");
+        doc.Parse(R"json({"table":"t_name", "where":{"path":{"like":"a\\b"}}})json");
+        escape.Config().escape_like_metachar = true;
+        escape.Config().fix_like_value = 0;
+        sql.clear();
+        COUT(escape.Select(doc, sql), true);
+        COUT(sql, "SELECT * FROM t_name WHERE 1=1 AND path like 'a\\\\\\\\b'");
+
+        jsonkit::CSqlBuilder plain;
+        plain.Config().escape_like_metachar = true;
+        plain.Config().fix_like_value = 0;
+        sql.clear();
+        COUT(plain.Select(doc, sql), true);
+        COUT(sql, "SELECT * FROM t_name WHERE 1=1 AND path like 'a\\\\b'");
+    }
+
+    DESC("limit offset");
+    {
+        rapidjson::Document doc;
+        doc.Parse(R"json({"table":"t_name", "where":{"id":{"gt":10}}, "limit":[100,20]})json");
+        std::string sql;
+        COUT(my.Select(doc, sql), true);
+        COUT(sql, "SELECT * FROM t_name WHERE 1=1 AND id>10 LIMIT 100,20");
+        sql.clear();
+        COUT(pg.Select(doc, sql), true);
+        COUT(sql, "SELECT * FROM t_name WHERE 1=1 AND id>10 LIMIT 20 OFFSET 100");
+
+        sql.clear();
+        jsonkit::sql_param_t params;
+        COUT(pg.Select(doc, sql, params), true);
+        COUT(sql, "SELECT * FROM t_name WHERE 1=1 AND id>$1 LIMIT $2 OFFSET $3");
+        COUT(params[1]->GetInt(), 20);
+    }
+
+    DESC("like pattern in prepared statement");
+    {
+        rapidjson::Document doc;
+        doc.Parse(R"json({"table":"t_name", "where":{"id":1, "name":{"like":"abc"}}})json");
+        std::string sql;
+        jsonkit::sql_param_t params;
+        COUT(my.Select(doc, sql, params), true);
+        COUT(sql, "SELECT * FROM t_name WHERE 1=1 AND id=? AND name like CONCAT(?,'%')");
+        sql.clear();
+        params.clear();
+        COUT(pg.Select(doc, sql, params), true);
+        COUT(sql, "SELECT * FROM t_name WHERE 1=1 AND id=$1 AND name like $2||'%'");
+        COUT(params.size(), 2);
+        COUT(params[1]->GetString(), std::string("abc"));
+
+        jsonkit::CSqlBuilder both;
+        both.Config() = jsonkit::sql_dialect_config(jsonkit::SQL_DIALECT_POSTGRES);
+        both.Config().fix_like_value = jsonkit::SQL_LIKE_PREFIX | jsonkit::SQL_LIKE_POSTFIX;
+        sql.clear();
+        params.clear();
+        COUT(both.Select(doc, sql, params), true);
+        COUT(sql, "SELECT * FROM t_name WHERE 1=1 AND id=$1 AND name like '%'||$2||'%'");
+    }
+
+    DESC("upsert and replace");
+    {
+        rapidjson::Document doc;
+        doc.Parse(R"json({"table":"t_name", "value":{"id":1, "name":"a"}, "update":{"name":"b"}, "conflict":"id"})json");
+        std::string sql;
+        COUT(my.Insert(doc, sql), true);
+        COUT(sql, "INSERT INTO t_name SET id=1,name='a' ON DUPLICATE KEY UPDATE name='b'");
+        sql.clear();
+        COUT(pg.Insert(doc, sql), true);
+        COUT(sql, "INSERT INTO t_name (id,name) VALUES (1,'a') ON CONFLICT (id) DO UPDATE SET name='b'");
+
+        doc.Parse(R"json({"table":"t_name", "value":[{"id":1, "name":"a"}], "update":{"name":"b"}, "conflict":"id"})json");
+        sql.clear();
+        COUT(pg.Insert(doc, sql), true);
+        COUT(sql, "INSERT INTO t_name (id,name) VALUES (1,'a') ON CONFLICT (id) DO UPDATE SET name='b'");
+
+        doc.Parse(R"json({"table":"t_name", "value":[{"id":1, "name":"a"}], "conflict":["id"], "last_insert_id":true})json");
+        sql.clear();
+        COUT(my.Replace(doc, sql), true);
+        COUT(sql, "REPLACE INTO t_name (id,name) VALUES (1,'a'); SELECT last_insert_id()");
+        sql.clear();
+        COUT(pg.Replace(doc, sql), true);
+        COUT(sql, "INSERT INTO t_name (id,name) VALUES (1,'a') ON CONFLICT (id) DO UPDATE SET id=EXCLUDED.id,name=EXCLUDED.name; SELECT lastval()");
+
+        DESC("replace without conflict keys fails in PostgreSQL");
+        doc.Parse(R"json({"table":"t_name", "value":[{"id":1, "name":"a"}]})json");
+        sql.clear();
+        COUT(pg.Replace(doc, sql), false);
+    }
+}
+
+DEF_TAST(sql_bulk_export, "tast export rows for bulk load")
+{
+    rapidjson::Document doc;
+    doc.Parse(R"json({
+    "table": "t_name",
+    "head": ["id", "name", "flag", "note"],
+    "value": [
+        [1, "a\tb", true, null],
+        [2, "c,\"d\"", false, "`null`"],
+        [3, "", true, {"k":"x\\y"}]
+    ]
+})json");
+    COUT(doc.HasParseError(), false);
+
+    DESC("head is alias of field in insert");
+    {
+        rapidjson::Document doc;
+        doc.Parse(R"json({"table":"t_name", "head":["id","name"], "value":[[1,"a"], [2,"b"]]})json");
+        std::string sql;
+        COUT(jsonkit::sql_insert(doc, sql), true);
+        COUT(sql, "INSERT INTO t_name (id,name) VALUES (1,'a'), (2,'b')");
+    }
+
+    DESC("PostgreSQL COPY text");
+    {
+        jsonkit::CSqlBulkExport bulk(doc);
+        std::string sql, data;
+        COUT(bulk.Command(sql), true);
+        COUT(sql, "COPY t_name (id,name,flag,note) FROM STDIN");
+        COUT(bulk.Write(data), true);
+        COUT(data, "1\ta\\tb\ttrue\t\\N\n2\tc,\"d\"\tfalse\t\\N\n3\t\ttrue\t{\"k\":\"x\\\\\\\\y\"}\n");
+    }
+
+    DESC("PostgreSQL COPY csv");
+    {
+        jsonkit::CSqlBulkExport bulk(doc, jsonkit::SQL_BULK_COPY_CSV);
+        std::string sql, data;
+        COUT(bulk.Command(sql), true);
+        COUT(sql, "COPY t_name (id,name,flag,note) FROM STDIN WITH (FORMAT csv)");
+        COUT(bulk.Write(data), true);
+        COUT(data, "1,a\tb,true,\n2,\"c,\"\"d\"\"\",false,\n3,\"\",true,\"{\"\"k\"\":\"\"x\\\\y\"\"}\"\n");
+    }
+
+    DESC("MySQL LOAD DATA from array of object, run with sink");
+    {
+        rapidjson::Document doc;
+        doc.Parse(R"json({"table":"t_name", "value":[{"id":1, "name":"a\nb"}, {"name":"c\\d", "id":2}, {"id":3}]})json");
+        jsonkit::CSqlBulkExport bulk(doc, jsonkit::SQL_BULK_LOAD_DATA);
+        std::string sql;
+        COUT(bulk.Command(sql, "data.tsv"), true);
+        COUT(sql, "LOAD DATA LOCAL INFILE 'data.tsv' INTO TABLE t_name (id,name)");
+
+        std::vector<std::string> chunks;
+        COUT(bulk.Run([&chunks](const std::string& data) {
+            chunks.push_back(data);
+            return true;
+        }, 4), true);
+        COUT(chunks.size(), 3);
+        COUT(chunks[0], "1\ta\\nb\n");
+        COUT(chunks[1], "2\tc\\\\d\n");
+        COUT(chunks[2], "3\t\\N\n");
+        COUT(bulk.RowDone(), 3);
+    }
+
+    DESC("raw sql is invalid in bulk data");
+    {
+        rapidjson::Document doc;
+        doc.Parse(R"json({"table":"t_name", "head":["id","time"], "value":[[1, "`now()`"]]})json");
+        jsonkit::CSqlBulkExport bulk(doc);
+        std::string data;
+        COUT(bulk.Write(data), false);
+        COUT(bulk.Error(), true);
+    }
+}
+
+DEF_TAST(sql_where_ops, "tast more operators and nested groups in where")
+{
+    DESC("in, not like, regexp, between");
+    {
+        rapidjson::Document doc;
+        doc.Parse(R"json({
+    "table": "t_name",
+    "where": {
+        "id": { "in": [1, 2], "not in": [], "between": [0, 9] },
+        "name": { "not like": "tmp", "regexp": "^a.*z$" },
+        "age": { "unknown": 1, "ge": 18 }
+    }
+})json");
+        std::string sql;
+        COUT(jsonkit::sql_select(doc, sql), true);
+        COUT(sql, "SELECT * FROM t_name WHERE 1=1 AND id IN (1,2) AND id BETWEEN 0 AND 9 AND name not like 'tmp%' AND name REGEXP '^a.*z$' AND age>=18");
+
+        jsonkit::CSqlBuilder pg;
+        pg.Config().dialect = jsonkit::SQL_DIALECT_POSTGRES;
+        sql.clear();
+        COUT(pg.Select(doc, sql), true);
+        COUT(sql, "SELECT * FROM t_name WHERE 1=1 AND id IN (1,2) AND id BETWEEN 0 AND 9 AND name not like 'tmp%' AND name ~ '^a.*z$' AND age>=18");
+    }
+
+    DESC("nested -and/-or group");
+    {
+        rapidjson::Document doc;
+        doc.Parse(R"json({
+    "table": "t_name",
+    "where": {
+        "del": 0,
+        "-or": [
+            { "type": 1, "score": { "between": [60, 100] } },
+            { "type": 2, "-or": { "vip": true, "-and": { "level": { "gt": 3 }, "days": { "ge": 30 } } } },
+            { "type": null }
+        ],
+        "-and": { "x": null }
+    }
+})json");
+        std::string sql;
+        COUT(jsonkit::sql_select(doc, sql), true);
+        COUT(sql, "SELECT * FROM t_name WHERE 1=1 AND del=0 AND ((type=1 AND score BETWEEN 60 AND 100) OR (type=2 AND (vip=1 OR (level>3 AND days>=30))))");
+    }
+
+    DESC("empty -or group matches nothing");
+    {
+        const char* where[] = {
+            R"json({"table":"t_name", "where":{"id":1, "-or":{}}})json",
+            R"json({"table":"t_name", "where":{"id":1, "-or":{"a":null}}})json",
+            R"json({"table":"t_name", "where":{"id":1, "-or":[{"a":null}]}})json",
+            R"json({"table":"t_name", "where":{"id":1, "-or":[]}})json",
+        };
+        for (auto json : where)
+        {
+            rapidjson::Document doc;
+            doc.Parse(json);
+            std::string sql;
+            COUT(jsonkit::sql_select(doc, sql), true);
+            COUT(sql, "SELECT * FROM t_name WHERE 1=1 AND id=1 AND (1!=1)");
+        }
+
+        rapidjson::Document doc;
+        doc.Parse(R"json({"table":"t_name", "where":{"-or":{}, "-and":{"a":null}}})json");
+        std::string sql;
+        COUT(jsonkit::sql_delete(doc, sql), true);
+        COUT(sql, "DELETE FROM t_name WHERE 1=1 AND (1!=1)");
+    }
+
+    DESC("in requires array");
+    {
+        rapidjson::Document doc;
+        doc.Parse(R"json({"table":"t_name", "where":{"id":{"in":1}}})json");
+        std::string sql;
+        COUT(jsonkit::sql_select(doc, sql), false);
+    }
+}
+
+DEF_TAST(sql_result_builder, "tast build json from sql result set")
+{
+    const char* rows[][4] = {
+        {"1", "alice", "3.5", "1"},
+        {"2", nullptr, "x", "f"},
+    };
+
+    DESC("array of object");
+    {
+        rapidjson::Document doc;
+        jsonkit::CSqlResultBuilder result(doc);
+        COUT(result.AddColumn("id", jsonkit::SQL_COLUMN_INT), true);
+        COUT(result.AddColumn("name"), true);
+        COUT(result.AddColumn("score", jsonkit::SQL_COLUMN_DOUBLE), true);
+        COUT(result.AddColumn("vip", jsonkit::SQL_COLUMN_BOOL), true);
+        result.Reserve(2);
+        COUT(result.AddRow(rows[0]), true);
+        COUT(result.AddRow(rows[1]), true);
+        COUT(result.AddColumn("late"), false);
+        COUT(result.RowCount(), 2);
+        COUT(jsonkit::stringfy(doc), std::string(R"json([{"id":1,"name":"alice","score":3.5,"vip":true},{"id":2,"name":null,"score":"x","vip":false}])json"));
+
+        DESC("key string is shared by rows");
+        COUT(doc[0].MemberBegin()->name.GetString() == doc[1].MemberBegin()->name.GetString(), true);
+    }
+
+    DESC("invalid cell for type is kept as string");
+    {
+        const char* cells[][3] = {
+            {"9223372036854775807", "1e300", "t"},
+            {"9223372036854775808", "nan", "x"},
+            {"-9223372036854775809", "inf", "2"},
+            {"12a", "0x10", "TRUE"},
+        };
+        rapidjson::Document doc;
+        jsonkit::CSqlResultBuilder result(doc, jsonkit::SQL_RESULT_COLUMNAR);
+        result.AddColumn("id", jsonkit::SQL_COLUMN_INT);
+        result.AddColumn("score", jsonkit::SQL_COLUMN_DOUBLE);
+        result.AddColumn("vip", jsonkit::SQL_COLUMN_BOOL);
+        for (auto& row : cells)
+        {
+            COUT(result.AddRow(row), true);
+        }
+        const rapidjson::Value& value = doc["value"];
+        COUT(value[0][0].GetInt64(), INT64_MAX);
+        COUT(value[0][1].IsDouble(), true);
+        COUT(value[0][2].GetBool(), true);
+        for (rapidjson::SizeType i = 1; i < value.Size(); ++i)
+        {
+            COUT(value[i][0].IsString() && value[i][1].IsString() && value[i][2].IsString(), true);
+        }
+        COUT(jsonkit::stringfy(doc).empty(), false);
+    }
+
+    DESC("columnar by callback");
+    {
+        rapidjson::Document doc;
+        jsonkit::CSqlResultBuilder result(doc, jsonkit::SQL_RESULT_COLUMNAR);
+        result.AddColumn("id", jsonkit::SQL_COLUMN_INT);
+        result.AddColumn("name");
+        std::string text = "12bob";
+        COUT(result.AddRow([&text](size_t col, size_t& len) {
+            len = (col == 0) ? 2 : 3;
+            return text.c_str() + (col == 0 ? 0 : 2);
+        }), true);
+        COUT(jsonkit::stringfy(doc), std::string(R"json({"head":["id","name"],"value":[[12,"bob"]]})json"));
+
+        DESC("columnar result is input of sql_insert");
+        doc.AddMember("table", "t_name", doc.GetAllocator());
+        std::string sql;
+        COUT(jsonkit::sql_insert(doc, sql), true);
+        COUT(sql, "INSERT INTO t_name (id,name) VALUES (12,'bob')");
+    }
+}
+
+DEF_TAST(sql_config_thread, "stress generate sql with different config in threads")
+{
+    rapidjson::Document doc;
+    doc.Parse(R"json({"table":"t_name", "where":{"name":{"like":"a_b"}, "path":"x\\y"}, "limit":[10,5]})json");
+    COUT(doc.HasParseError(), false);
+
+    std::vector<jsonkit::sql_config_t> configs(4);
+    configs[1].fix_like_value = jsonkit::SQL_LIKE_PREFIX | jsonkit::SQL_LIKE_POSTFIX;
+    configs[2].escape_like_metachar = true;
+    configs[3] = jsonkit::sql_dialect_config(jsonkit::SQL_DIALECT_POSTGRES);
+
+    std::vector<std::string> expect(configs.size());
+    for (size_t i = 0; i < configs.size(); ++i)
+    {
+        COUT(jsonkit::sql_select(doc, expect[i], configs[i]), true);
+        COUT(expect[i]);
+    }
+    COUT(expect[0] != expect[1] && expect[0] != expect[2] && expect[0] != expect[3], true);
+
+    const jsonkit::CSqlBuilder shared(configs[1]);
+    std::string sharedExpect;
+    COUT(shared.Select(doc, sharedExpect), true);
+    COUT(sharedExpect, expect[1]);
+
+    jsonkit::sql_config_t origin = jsonkit::set_sql_config(&configs[0]);
+    std::atomic<int> error(0);
+    std::atomic<bool> stop(false);
+
+    DESC("change default config while other threads generating");
+    std::thread toggle([&]() {
+        for (int i = 0; !stop; ++i)
+        {
+            jsonkit::set_sql_config(&configs[(i % 2) * 2]);
+            std::this_thread::yield();
+        }
+    });
+
+    std::vector<std::thread> workers;
+    for (int t = 0; t < 8; ++t)
+    {
+        workers.emplace_back([&, t]() {
+            for (int i = 0; i < 2000; ++i)
+            {
+                size_t k = (t + i) % configs.size();
+                std::string sql;
+                if (!jsonkit::sql_select(doc, sql, configs[k]) || sql != expect[k])
+                {
+                    ++error;
+                }
+                sql.clear();
+                if (!shared.Select(doc, sql) || sql != sharedExpect)
+                {
+                    ++error;
+                }
+                sql.clear();
+                if (!jsonkit::sql_select(doc, sql) || (sql != expect[0] && sql != expect[2]))
+                {
+                    ++error;
+                }
+            }
+        });
+    }
+
+    for (auto& th : workers)
+    {
+        th.join();
+    }
+    stop = true;
+    toggle.join();
+    jsonkit::set_sql_config(&origin);
+
+    COUT(error.load(), 0);
+}